@@ -0,0 +1,68 @@
+#ifndef CHANNEL_POOL_H
+#define CHANNEL_POOL_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include <grpcpp/grpcpp.h>
+#include "media_service.grpc.pb.h"
+
+// A fixed set of channels to one server. Every channel gets its own
+// channel args and a local subchannel pool, so each one opens its own
+// HTTP/2 connection with its own flow control and congestion window,
+// instead of all streams queueing on a single connection.
+class ChannelPool {
+public:
+    using Stub = mediaupload::MediaUploadService::Stub;
+
+    struct ChannelStats {
+        int streams;
+        uint64_t bytes;
+    };
+
+    // A channel held for one upload stream; returned to the pool on destruction
+    class Lease {
+    public:
+        Lease() = default;
+        Lease(ChannelPool* pool, int index) : pool_(pool), index_(index) {}
+        Lease(Lease&& other) noexcept;
+        Lease& operator=(Lease&& other) noexcept;
+        ~Lease();
+
+        Stub* stub() const { return pool_->stub(index_); }
+        int index() const { return index_; }
+        // Counts bytes sent on this stream towards the channel's throughput
+        void addBytes(uint64_t bytes) { pool_->channels_[index_]->bytes += bytes; }
+
+    private:
+        ChannelPool* pool_ = nullptr;
+        int index_ = -1;
+    };
+
+    ChannelPool(const std::string& server_address, int size);
+    // Wraps channels made elsewhere, such as a server's in-process channels
+    explicit ChannelPool(const std::vector<std::shared_ptr<grpc::Channel>>& channels);
+
+    // The channel with the fewest active streams
+    Lease acquire();
+    // Fixed channel for small calls such as GetQueueStatus
+    Stub* stub(int index) const { return channels_[index % channels_.size()]->stub.get(); }
+
+    int size() const { return static_cast<int>(channels_.size()); }
+    std::vector<ChannelStats> getStatistics() const;
+
+private:
+    struct PooledChannel {
+        std::shared_ptr<grpc::Channel> channel;
+        std::unique_ptr<Stub> stub;
+        std::atomic<int> active{0};
+        std::atomic<int> streams{0};
+        std::atomic<uint64_t> bytes{0};
+    };
+
+    std::vector<std::unique_ptr<PooledChannel>> channels_;
+};
+
+#endif // CHANNEL_POOL_H
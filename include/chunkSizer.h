@@ -0,0 +1,51 @@
+#ifndef CHUNK_SIZER_H
+#define CHUNK_SIZER_H
+
+#include <cstddef>
+#include <chrono>
+#include <vector>
+
+// Picks the upload chunk size between two bounds from the throughput
+// observed around ClientWriter::Write. Small chunks pay per-message
+// overhead on fast links; large ones make every write block for long on
+// slow or lossy links, so write latency caps the size.
+//
+// Candidate sizes are the powers of two between the bounds. Each keeps a
+// smoothed throughput estimate; the sizer settles on the best one and
+// now and then probes a neighbour, so a single noisy measurement can't
+// pin it to a bad size.
+class ChunkSizer {
+public:
+    ChunkSizer(size_t min_size, size_t max_size, size_t initial_size);
+
+    size_t chunkSize() const { return chunk_size_; }
+    bool isFixed() const { return sizes_.size() == 1; }
+
+    // Reports one write of `bytes` that took `elapsed`
+    void recordWrite(size_t bytes, std::chrono::steady_clock::duration elapsed);
+
+private:
+    static constexpr int WINDOW_WRITES = 16;
+    static constexpr std::chrono::milliseconds MIN_WINDOW{100};
+    static constexpr std::chrono::milliseconds MAX_WRITE_LATENCY{100};
+    static constexpr double SMOOTHING = 0.3;  // weight of the newest window
+    static constexpr int PROBE_INTERVAL = 8;  // windows between neighbour probes
+
+    void select(size_t index);
+    size_t nextIndex();
+
+    std::vector<size_t> sizes_;
+    std::vector<double> throughput_;  // bytes/sec per size, 0 = not measured
+    size_t index_;
+    size_t limit_;                    // largest index whose writes stay fast enough
+    size_t chunk_size_;
+
+    int windows_;
+    bool probe_up_;
+
+    size_t window_bytes_;
+    int window_writes_;
+    std::chrono::steady_clock::duration window_time_;
+};
+
+#endif // CHUNK_SIZER_H
@@ -0,0 +1,18 @@
+#ifndef COMMAND_LINE_H
+#define COMMAND_LINE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Parsers for option values shared by the command-line tools
+
+// Splits "host1:50051,host2:50051", skipping empty entries
+std::vector<std::string> splitAddresses(const std::string& list);
+
+// Parses an amount such as "500K", "6.4M" or "1.25G", where each suffix
+// multiplies by another power of `unit` (1024 for sizes, 1000 for rates).
+// False if malformed or negative; callers check their own bounds.
+bool parseQuantity(const std::string& text, double unit, uint64_t& result);
+
+#endif // COMMAND_LINE_H
@@ -3,24 +3,32 @@
 
 #include <string>
 #include <vector>
-#include <queue>
+#include <deque>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 #include <unordered_map>
 #include <unordered_set>
 #include <chrono>
+#include <atomic>
 #include <grpcpp/grpcpp.h>
 #include "media_service.grpc.pb.h"
+#include "tracer.h"
+#include "memoryBudget.h"
+#include "cpuAffinity.h"
 
 using grpc::Server;
 using grpc::ServerBuilder;
 using grpc::ServerContext;
 using grpc::ServerReader;
+using grpc::ServerReaderWriter;
 using grpc::Status;
 using mediaupload::MediaUploadService;
 using mediaupload::VideoChunk;
+using mediaupload::UploadFrame;
 using mediaupload::UploadResponse;
+using mediaupload::CreditRequest;
+using mediaupload::CreditGrant;
 using mediaupload::QueueStatusRequest;
 using mediaupload::QueueStatusResponse;
 using mediaupload::StatisticsRequest;
@@ -33,6 +41,10 @@ struct UploadTask {
     std::vector<char> data;
     std::string file_hash;
     size_t total_size;
+    uint64_t trace_id = 0;     // 0 = not traced
+    int64_t enqueued_us = 0;   // set for traced uploads, for the queue wait span
+    std::string spool_path;    // set when restored from the spool; removed once saved
+    int numa_node = -1;        // node whose memory holds `data`, -1 = unknown
 };
 
 struct VideoMetadata {
@@ -45,6 +57,23 @@ struct VideoMetadata {
     size_t file_size;
     std::chrono::system_clock::time_point upload_time;
     bool is_duplicate;
+    uint64_t version;   // metadata version at which this entry was added
+};
+
+struct ServerStatistics {
+    int total_received;
+    int total_processed;
+    int total_dropped;
+    int total_duplicates;
+    int queue_size;
+    int max_queue_size;
+    // Upload receive buffers (see MemoryBudget)
+    uint64_t memory_in_use;
+    uint64_t memory_limit;     // 0 = unlimited
+    uint64_t memory_peak;
+    int memory_waiting;        // uploads blocked on the budget right now
+    uint64_t memory_waits;
+    uint64_t memory_blocked_ms;
 };
 
 class ConsumerServer final : public MediaUploadService::Service {
@@ -52,11 +81,26 @@ public:
     ConsumerServer(int num_consumers, int max_queue_size, 
                    const std::string& output_dir);
 
+    // Largest upload message accepted, leaving room for any chunk size
+    // the producer may pick
+    static constexpr int MAX_MESSAGE_SIZE = 16 * 1024 * 1024;
+    // A granted credit no upload header has named by then goes back to
+    // the pool, so a producer that dies or fails before sending its
+    // header can't hold a queue slot forever
+    static constexpr int CREDIT_CLAIM_TIMEOUT_SEC = 30;
+
     // gRPC service methods
     Status UploadVideo(ServerContext* context,
                       ServerReader<VideoChunk>* reader,
                       UploadResponse* response) override;
 
+    Status UploadVideoFrames(ServerContext* context,
+                             ServerReader<UploadFrame>* reader,
+                             UploadResponse* response) override;
+
+    Status Subscribe(ServerContext* context,
+                     ServerReaderWriter<CreditGrant, CreditRequest>* stream) override;
+
     Status GetQueueStatus(ServerContext* context,
                          const QueueStatusRequest* request,
                          QueueStatusResponse* response) override;
@@ -65,39 +109,165 @@ public:
                         const StatisticsRequest* request,
                         StatisticsResponse* response) override;
 
+    // Simulated per-video processing time of the consumer workers
+    void setProcessingDelay(std::chrono::milliseconds delay) { processing_delay_ = delay; }
+
+    // Spans of sampled uploads, for /api/trace
+    Tracer& tracer() { return tracer_; }
+
+    // Bytes all uploads together may be receiving at once, 0 = unlimited
+    void setMemoryLimit(size_t bytes) { memory_budget_.setLimit(bytes); }
+
+    // CPUs for the consumer workers and upload RPC threads; call before start()
+    void setThreadPlacement(const ThreadPlacement& placement);
+
+    // Restores uploads spooled by the last stop(), then starts the workers
     void start();
-    void stop();
+    // Refuses new uploads and credits from here on; uploads already
+    // streaming still complete. Call before shutting the gRPC server down.
+    void beginShutdown();
+    // Keeps processing queued uploads until the queue is empty or the
+    // deadline passes, then spools whatever is left for the next start
+    void stop(std::chrono::steady_clock::time_point drain_deadline = {});
     void printStatistics();
     std::vector<VideoMetadata> getVideoMetadata();
 
+    // The metadata list is append-only; every append bumps the version.
+    // Versions start from the startup time in microseconds, so a version
+    // remembered from an earlier server run is always older than any new one.
+    uint64_t getMetadataVersion();
+    std::vector<VideoMetadata> getVideoMetadataSince(uint64_t since_version,
+                                                     uint64_t* current_version);
+
+    ServerStatistics getStatistics();
+
+    // Blocks until queue, statistics or metadata change (or the timeout
+    // passes) and returns the latest change sequence number
+    uint64_t waitForChange(uint64_t seen_seq, std::chrono::milliseconds timeout);
+
 private:
-    void consumerWorker(int consumer_id);
+    // Lets server_microbench time the hot paths below without a network
+    friend struct ConsumerServerBenchAccess;
+
+    // Verifies, deduplicates and queues a fully received upload;
+    // expected_hash is the producer's SHA-256, empty if it sent none
+    Status acceptUpload(const std::string& video_id, const std::string& filename,
+                        int producer_id, size_t total_size,
+                        const std::string& expected_hash, uint64_t credit_id,
+                        uint64_t trace_id, std::vector<char> video_data,
+                        UploadResponse* response);
+    // The producer's trace id from the request metadata, or a sampled
+    // one of our own; 0 = not traced
+    uint64_t traceIdFor(ServerContext* context);
+    // Refusals for uploads the memory budget can't cover: one announced
+    // larger than the whole budget, or one sending past its announced size
+    Status uploadTooLarge(const std::string& filename, size_t total_size);
+    Status oversizedUpload(const std::string& filename, size_t total_size);
+    // An upload stream that ended before its is_last message (or with a
+    // different size than announced); nothing of it is kept
+    Status incompleteUpload(ServerContext* context, const std::string& filename,
+                            size_t received, size_t total_size);
+    // node: the NUMA node the worker is pinned to, -1 = none
+    void consumerWorker(int consumer_id, int node);
+    // Waits for the next queued upload; false once the server is stopping.
+    // With NUMA dispatch a worker takes uploads received on its own node
+    // first, and others' only while their node has no worker free.
+    bool popTask(UploadTask& task, int node = -1);
+    std::deque<UploadTask>::iterator findTask(int node);  // caller holds queue_mutex_
+    // Pins the calling RPC thread the first time it serves an upload
+    void placeRpcThread();
+    // One Subscribe stream's credits (guarded by queue_mutex_)
+    struct CreditSubscription {
+        int requested = 0;
+        // Grant times of credits no upload header has named yet, oldest first
+        std::deque<std::chrono::steady_clock::time_point> unclaimed;
+        int claimed = 0;  // named by an upload still being received
+        bool closed = false;
+        int outstanding() const { return static_cast<int>(unclaimed.size()) + claimed; }
+    };
+
+    // The queue slot reserved by the credit an upload header named. It
+    // goes back to the pool on every way out of the handler, unless it
+    // was handed to acceptUpload, which settles it itself.
+    class CreditClaim {
+    public:
+        explicit CreditClaim(ConsumerServer& server) : server_(server), credit_id_(0) {}
+        ~CreditClaim() { server_.releaseCredit(take()); }
+        CreditClaim(const CreditClaim&) = delete;
+        CreditClaim& operator=(const CreditClaim&) = delete;
+
+        void claim(uint64_t credit_id);
+        uint64_t take() { uint64_t id = credit_id_; credit_id_ = 0; return id; }
+
+    private:
+        ConsumerServer& server_;
+        uint64_t credit_id_;  // 0 = none, or it expired before the header came
+    };
+
+    // Credit bookkeeping; callers hold queue_mutex_
+    int freeSlots() const;
+    bool redeemCredit(uint64_t credit_id);
+    int expireCredits(CreditSubscription& subscription);
+    // Gives a claimed credit's slot back without queueing anything
+    void releaseCredit(uint64_t credit_id);
+    void appendMetadata(VideoMetadata meta);  // caller holds metadata_mutex_
+    void notifyChange();
     void generateThumbnail(const std::string& video_path, 
                           const std::string& video_id);
-    std::string calculateHash(const std::vector<char>& data);
+    // Queued uploads saved across restarts, one file each in spool_dir_
+    size_t loadSpool();
+    size_t spoolQueue();  // caller holds queue_mutex_
+    bool writeSpoolFile(const UploadTask& task, const std::string& path);
+    bool readSpoolFile(const std::string& path, UploadTask& task);
+    static void appendChunk(std::vector<char>& video_data, const std::string& chunk);
+    static std::string calculateHash(const std::vector<char>& data);
+    static std::string hexEncode(const unsigned char* data, size_t length);
 
     int num_consumers_;
     int max_queue_size_;
     std::string output_dir_;
+    std::chrono::milliseconds processing_delay_;
+    std::string spool_dir_;
+    Tracer tracer_;
+    MemoryBudget memory_budget_;
 
-    std::queue<UploadTask> upload_queue_;
+    std::deque<UploadTask> upload_queue_;
     std::mutex queue_mutex_;
     std::condition_variable queue_cv_;
 
+    // Upload credits: slots granted to Subscribe streams but not yet
+    // filled by an upload count as taken (guarded by queue_mutex_)
+    std::unordered_map<uint64_t, std::shared_ptr<CreditSubscription>> credit_subscriptions_;
+    uint64_t next_subscription_id_;
+    int reserved_slots_;
+    std::condition_variable credit_cv_;
+
+    ThreadPlacement placement_;
+    bool numa_dispatch_;             // placement_.numa on a machine with several nodes
+    std::vector<int> idle_workers_;  // per node, waiting in popTask (guarded by queue_mutex_)
+    std::atomic<int> next_rpc_node_;
+
     std::vector<std::thread> consumer_threads_;
     bool running_;
+    std::atomic<bool> draining_;
 
     // Metadata tracking
     std::vector<VideoMetadata> video_metadata_;
     std::unordered_map<std::string, std::string> processed_videos_;
     std::unordered_set<std::string> uploaded_hashes_;
+    uint64_t metadata_version_;
     std::mutex metadata_mutex_;
     std::mutex hash_mutex_;
 
     // Statistics
-    int total_received_;
-    int total_dropped_;
-    int total_duplicates_;
+    std::atomic<int> total_received_;
+    std::atomic<int> total_dropped_;
+    std::atomic<int> total_duplicates_;
+
+    // Change notification for live dashboard updates
+    std::mutex change_mutex_;
+    std::condition_variable change_cv_;
+    uint64_t change_seq_;
 };
 
 #endif // CONSUMER_SERVER_H
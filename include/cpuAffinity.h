@@ -0,0 +1,44 @@
+#ifndef CPU_AFFINITY_H
+#define CPU_AFFINITY_H
+
+#include <string>
+#include <vector>
+
+// Which CPUs each kind of server thread may run on; empty = anywhere
+struct ThreadPlacement {
+    std::vector<int> consumer_cpus;
+    std::vector<int> grpc_cpus;   // threads running upload RPCs
+    std::vector<int> web_cpus;
+    // One group of consumers per NUMA node, each fed the uploads that
+    // were received on its node
+    bool numa = false;
+};
+
+// Thread pinning and the machine's NUMA layout, read from sysfs once.
+// Linux only; elsewhere pinning does nothing and everything is node 0.
+//
+// Upload buffers are allocated by the thread that receives the upload,
+// and the kernel places memory on the node of the CPU that first touches
+// it, so an upload's node is the node its receiving thread ran on.
+class CpuAffinity {
+public:
+    // Parses "0-3,8,10-11"
+    static bool parseCpuList(const std::string& text, std::vector<int>& cpus);
+    static std::string formatCpuList(const std::vector<int>& cpus);
+
+    // Restricts the calling thread to `cpus`; threads it starts inherit this
+    static bool pinCurrentThread(const std::vector<int>& cpus);
+    static bool pinCurrentThread(int cpu) { return pinCurrentThread(std::vector<int>{cpu}); }
+    // CPUs the calling thread may run on now
+    static std::vector<int> currentCpus();
+
+    static int nodeCount();
+    static std::vector<int> nodeCpus(int node);
+    static int nodeOfCpu(int cpu);             // 0 if unknown
+    // The node all of `cpus` belong to, -1 if they span several
+    static int nodeOfCpus(const std::vector<int>& cpus);
+    // The node the calling thread is running on right now
+    static int currentNode();
+};
+
+#endif // CPU_AFFINITY_H
@@ -0,0 +1,58 @@
+#ifndef DIRECTORY_WATCHER_H
+#define DIRECTORY_WATCHER_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <chrono>
+#include <thread>
+#include <atomic>
+
+// Reports files that finish landing in a set of directories: closed
+// after writing, or moved in (inotify, Linux only). A closed file is
+// only reported once it has been left alone for SETTLE_MS, so a writer
+// that closes and reopens it is not caught halfway. If the kernel's
+// event queue overflows, every file in the directories is reported
+// again and the callback is expected to skip the ones it already has.
+class DirectoryWatcher {
+public:
+    // on_file(index, path) runs on the watcher thread; index is the
+    // position of the file's directory in the list passed to start()
+    using Callback = std::function<void(int, const std::string&)>;
+
+    explicit DirectoryWatcher(Callback on_file);
+    ~DirectoryWatcher();
+
+    DirectoryWatcher(const DirectoryWatcher&) = delete;
+    DirectoryWatcher& operator=(const DirectoryWatcher&) = delete;
+
+    // False if inotify is unavailable or no directory could be watched
+    bool start(const std::vector<std::string>& dirs);
+    void stop();
+
+private:
+    static constexpr int POLL_INTERVAL_MS = 500;
+    static constexpr int SETTLE_MS = 1000;  // quiet time before a closed file is reported
+
+    struct Settling {
+        int index;
+        std::chrono::steady_clock::time_point due;
+    };
+
+    void watchLoop();
+    // Events were lost; puts every file in the watched directories back to settle
+    void rescan();
+    // Reports the files whose settle time is up
+    void reportSettled();
+    int pollTimeout() const;
+
+    Callback on_file_;
+    std::unordered_map<int, std::pair<int, std::string>> watches_;  // wd -> (index, dir)
+    std::unordered_map<std::string, Settling> settling_;             // path -> pending report
+    std::atomic<bool> running_;
+    std::thread watch_thread_;
+    int inotify_fd_;
+};
+
+#endif // DIRECTORY_WATCHER_H
@@ -0,0 +1,121 @@
+#ifndef FILE_WORK_QUEUE_H
+#define FILE_WORK_QUEUE_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <queue>
+#include <unordered_set>
+#include <unordered_map>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include "uploadLedger.h"
+#include "retryJournal.h"
+
+struct FileTask {
+    std::string path;
+    uint64_t size;
+    int owner;  // index of the producer whose directory the file came from
+};
+
+// Hands out the files of a batch to producer threads.
+//
+//   PerDirectory  each producer uploads its own directory, in scan order
+//   WorkStealing  each producer uploads its own directory largest-first,
+//                 then takes the largest files left in the fullest other one
+//   Shared        all files form one queue, largest-first
+//
+// Taking the largest remaining file first keeps the batch from ending
+// with one thread alone on a big file while the others sit idle.
+//
+// A continuous queue stays open for files added while producers run
+// (daemon mode): next() waits for one instead of reporting the end.
+// With a ledger, files it has on record are never queued and every
+// queued file is recorded once it has been delivered.
+//
+// Failed uploads come back through complete(): the journal picks a
+// backoff and the file waits in a shared retry queue, handed to the
+// next producer that asks once it is due. Until it is due, producers
+// carry on with fresh files.
+class FileWorkQueue {
+public:
+    enum class Mode { PerDirectory, WorkStealing, Shared };
+
+    FileWorkQueue(Mode mode, int num_producers);
+
+    // Adds the video files found in dir as owned by producer `owner`;
+    // call for every producer before the threads start
+    size_t addDirectory(int owner, const std::string& dir);
+    // Adds a single file that appeared in producer `owner`'s directory.
+    // A file written again while its upload is queued or running is
+    // added once more when that upload ends.
+    bool addFile(int owner, const std::string& path);
+
+    void setLedger(std::shared_ptr<UploadLedger> ledger) { ledger_ = std::move(ledger); }
+    void setJournal(std::shared_ptr<RetryJournal> journal) { journal_ = std::move(journal); }
+    // Queues the retries an earlier run left in the journal; call before
+    // addDirectory so those files are not queued twice
+    size_t replayJournal();
+    void setContinuous(bool continuous) { continuous_ = continuous; }
+    bool isContinuous() const { return continuous_; }
+
+    // Next file for producer `index`; waits while more may still come
+    // (files in flight may fail, retries not due yet, daemon mode) and
+    // returns false once it has nothing left to do
+    bool next(int index, FileTask& task);
+    // next() without the waiting
+    bool tryNext(int index, FileTask& task);
+    // Reports how a file handed out by next() ended. Returns true if it
+    // will be retried, after `delay`, as the given attempt.
+    bool complete(const FileTask& task, UploadOutcome outcome,
+                  int& attempt, std::chrono::milliseconds& delay);
+    // Makes next() return false; retries not made are left in the journal
+    void stop();
+
+    size_t pendingRetries();
+
+    // Whether next(index) has a file for now, or a retry coming up
+    bool hasWork(int index);
+    size_t totalFiles() const { return total_files_; }
+    uint64_t totalBytes() const { return total_bytes_; }
+
+    static bool isVideoFile(const std::string& filename);
+    static std::string absolutePath(const std::string& path);
+    static bool parseMode(const std::string& name, Mode& mode);
+    static const char* modeName(Mode mode);
+
+private:
+    std::deque<FileTask>& queueFor(int index);
+    void sortLargestFirst(std::deque<FileTask>& queue);
+    // Checks the ledger; mutex_ must be held
+    bool enqueue(std::deque<FileTask>& queue, FileTask task, int64_t mtime);
+    bool takeNext(int index, FileTask& task);
+
+    Mode mode_;
+    std::vector<std::deque<FileTask>> queues_;  // one per producer, or one shared
+    std::vector<uint64_t> queued_bytes_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    struct Retry {
+        FileTask task;
+        std::chrono::steady_clock::time_point due;
+        bool operator>(const Retry& other) const { return due > other.due; }
+    };
+
+    std::shared_ptr<UploadLedger> ledger_;
+    std::shared_ptr<RetryJournal> journal_;
+    std::priority_queue<Retry, std::vector<Retry>, std::greater<Retry>> retries_;
+    std::unordered_set<std::string> retry_paths_;
+    std::unordered_map<std::string, int> changed_;  // rewritten while claimed -> owner
+    int in_flight_;  // handed out by next() and not completed yet
+    std::atomic<bool> continuous_;
+    std::atomic<bool> stopping_;
+    size_t total_files_;
+    uint64_t total_bytes_;
+};
+
+#endif // FILE_WORK_QUEUE_H
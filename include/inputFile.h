@@ -0,0 +1,44 @@
+#ifndef INPUT_FILE_H
+#define INPUT_FILE_H
+
+#include <string>
+#include <cstddef>
+
+// A file being uploaded, read with pread() at explicit offsets so the
+// sender and the read-ahead thread can share it. Each read copies from
+// the page cache straight into the caller's buffer (for the sender, the
+// outgoing message), the one copy the upload needs anyway.
+//
+// Unlike reading through a memory mapping, a file that is truncated or
+// rewritten mid-upload can't fault the process: the read comes up short
+// and the upload fails instead.
+class InputFile {
+public:
+    InputFile() = default;
+    ~InputFile();
+
+    InputFile(const InputFile&) = delete;
+    InputFile& operator=(const InputFile&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    // Size when opened; that is how much gets uploaded
+    size_t size() const { return size_; }
+
+    // Copies [offset, offset + length) into out. False if the file has
+    // shrunk below that range or can't be read.
+    bool read(size_t offset, size_t length, char* out) const;
+    // Asks the kernel to start reading [offset, offset + length) ahead of use
+    void willNeed(size_t offset, size_t length) const;
+
+private:
+    size_t size_ = 0;
+#ifdef _WIN32
+    void* handle_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+};
+
+#endif // INPUT_FILE_H
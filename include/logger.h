@@ -0,0 +1,114 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <string>
+#include <sstream>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+
+enum class LogLevel {
+    Debug,
+    Info,
+    Warn,
+    Error,
+    Off
+};
+
+// Asynchronous logger. Each thread appends to its own ring buffer without
+// taking a lock, and one background thread writes everything out in
+// batches: Debug and Info to stdout, Warn and Error to stderr. A message
+// below the current level costs one relaxed load and is never formatted.
+// When a thread's ring is full its messages are dropped and counted.
+class Logger {
+public:
+    static constexpr size_t RING_SIZE = 1024;        // messages per thread
+    static constexpr int WRITE_INTERVAL_MS = 20;
+    static constexpr int DEFAULT_RATE_LIMIT = 100;   // per call site per second
+
+    // Rate limiting state of one LOG_* call site
+    struct Site {
+        std::atomic<int64_t> second{0};
+        std::atomic<int> count{0};
+        std::atomic<int> suppressed{0};
+    };
+
+    static Logger& instance();
+
+    static bool enabled(LogLevel level) {
+        return level >= level_.load(std::memory_order_relaxed);
+    }
+    static void setLevel(LogLevel level) { level_ = level; }
+    static LogLevel level() { return level_; }
+    // At most this many messages per second from one call site, 0 = no limit
+    static void setRateLimit(int per_second) { rate_limit_ = per_second; }
+
+    static bool parseLevel(const std::string& name, LogLevel& level);
+    static const char* levelName(LogLevel level);
+
+    // Whether the site may log now; `suppressed` is how many of its
+    // messages were held back since it last got through
+    static bool admit(Site& site, int& suppressed);
+
+    void write(LogLevel level, std::string message, int suppressed = 0);
+    // Writes out everything logged so far; call before printing directly
+    // to std::cout so the output stays in order
+    void flush();
+
+private:
+    struct Entry {
+        uint64_t seq;
+        LogLevel level;
+        std::string text;
+    };
+
+    // Single producer (the owning thread), single consumer (the writer)
+    struct Ring {
+        Entry entries[RING_SIZE];
+        std::atomic<uint64_t> head{0};   // next slot to fill
+        std::atomic<uint64_t> tail{0};   // next slot to write out
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<bool> closed{false}; // owning thread has exited
+    };
+
+    friend struct RingHandle;
+
+    Logger();
+
+    Ring* localRing();
+    void run();
+    void drain();
+
+    static std::atomic<LogLevel> level_;
+    static std::atomic<int> rate_limit_;
+
+    std::atomic<uint64_t> next_seq_;
+    std::mutex rings_mutex_;
+    std::vector<std::unique_ptr<Ring>> rings_;
+    std::mutex drain_mutex_;
+    std::vector<Entry> batch_;
+    std::string out_;
+    std::string err_;
+};
+
+#define LOG_AT(log_level, expr)                                                   \
+    do {                                                                          \
+        if (Logger::enabled(log_level)) {                                         \
+            static Logger::Site log_site_;                                        \
+            int log_suppressed_ = 0;                                              \
+            if (Logger::admit(log_site_, log_suppressed_)) {                      \
+                std::ostringstream log_stream_;                                   \
+                log_stream_ << expr;                                              \
+                Logger::instance().write(log_level, log_stream_.str(), log_suppressed_); \
+            }                                                                     \
+        }                                                                         \
+    } while (0)
+
+#define LOG_DEBUG(expr) LOG_AT(LogLevel::Debug, expr)
+#define LOG_INFO(expr) LOG_AT(LogLevel::Info, expr)
+#define LOG_WARN(expr) LOG_AT(LogLevel::Warn, expr)
+#define LOG_ERROR(expr) LOG_AT(LogLevel::Error, expr)
+
+#endif // LOGGER_H
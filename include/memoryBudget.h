@@ -0,0 +1,85 @@
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+
+struct MemoryBudgetStats {
+    size_t limit;         // 0 = unlimited
+    size_t in_use;
+    size_t peak;
+    uint64_t waits;       // acquire() calls that had to block
+    int waiting;          // blocked right now
+    uint64_t blocked_ms;  // total time spent blocked
+};
+
+// Server-wide byte budget for upload receive buffers. An upload handler
+// reserves its buffer before reading the data; while the budget is
+// exhausted it blocks and stops calling Read(), so gRPC's flow control
+// holds the producers back instead of the process running out of memory.
+// Handlers refuse data past what they reserved, so every byte held is
+// covered by a reservation.
+class MemoryBudget {
+public:
+    static constexpr size_t DEFAULT_LIMIT = 1024ull * 1024 * 1024;
+    static constexpr int POLL_INTERVAL_MS = 100;  // how often `cancelled` is checked
+
+    explicit MemoryBudget(size_t limit = DEFAULT_LIMIT);
+
+    void setLimit(size_t limit);
+
+    // Whether a reservation of `bytes` can ever be granted
+    bool admits(size_t bytes);
+    // Blocks until `bytes` fit, or `cancelled` returns true (false then).
+    // Waiters are served in arrival order, so a large request isn't
+    // starved by smaller ones that keep slipping in ahead of it.
+    bool acquire(size_t bytes, const std::function<bool()>& cancelled);
+    void release(size_t bytes);
+
+    MemoryBudgetStats stats();
+
+private:
+    bool fits(size_t bytes) const;
+
+    std::mutex mutex_;
+    std::condition_variable released_cv_;
+    size_t limit_;
+    size_t in_use_;
+    size_t peak_;
+    uint64_t waits_;
+    int waiting_;
+    uint64_t blocked_us_;
+    std::deque<uint64_t> queue_;  // tickets of blocked acquire() calls, oldest first
+    uint64_t next_ticket_;
+};
+
+// The bytes one upload holds in a MemoryBudget; gives them back when
+// destroyed
+class BudgetLease {
+public:
+    explicit BudgetLease(MemoryBudget& budget) : budget_(budget), held_(0) {}
+    ~BudgetLease() { budget_.release(held_); }
+
+    BudgetLease(const BudgetLease&) = delete;
+    BudgetLease& operator=(const BudgetLease&) = delete;
+
+    bool acquire(size_t bytes, const std::function<bool()>& cancelled) {
+        if (!budget_.acquire(bytes, cancelled)) {
+            return false;
+        }
+        held_ += bytes;
+        return true;
+    }
+
+    size_t held() const { return held_; }
+
+private:
+    MemoryBudget& budget_;
+    size_t held_;
+};
+
+#endif // MEMORY_BUDGET_H
@@ -4,27 +4,51 @@
 #include <string>
 #include <vector>
 #include <thread>
+#include <mutex>
 #include <memory>
 #include <grpcpp/grpcpp.h>
 #include "producerThread.h"
+#include "directoryWatcher.h"
+#include "uploadLedger.h"
 
 using grpc::Channel;
 
 class ProducerClient {
 public:
+    // server_address may list several servers, comma-separated; files are
+    // then sharded over them by content hash (see ShardRouter)
     ProducerClient(int num_producers, const std::string& base_input_dir,
-                  const std::string& server_address);
+                  const std::string& server_address,
+                  const ProducerOptions& options = ProducerOptions());
+    // Uploads over the given channels instead of connecting to an address
+    ProducerClient(int num_producers, const std::string& base_input_dir,
+                  std::shared_ptr<ChannelPool> channels,
+                  const ProducerOptions& options = ProducerOptions());
 
     void start();
     void stop();
     void printStatistics();
 
 private:
+    ProducerClient(int num_producers, const std::string& base_input_dir,
+                  const std::string& server_address, std::shared_ptr<ShardRouter> shards,
+                  const ProducerOptions& options);
+
     int num_producers_;
     std::string base_input_dir_;
     std::string server_address_;
+    ProducerOptions options_;
     
-    std::shared_ptr<Channel> channel_;
+    std::shared_ptr<ShardRouter> shards_;
+    std::shared_ptr<RateLimiter> global_limiter_;
+    std::shared_ptr<FileWorkQueue> work_queue_;
+    std::shared_ptr<UploadLedger> ledger_;
+    std::shared_ptr<RetryJournal> journal_;
+    std::unique_ptr<DirectoryWatcher> watcher_;
+    double elapsed_seconds_;
+    // stop() runs on another thread, possibly while start() is still
+    // adding producers
+    std::mutex producers_mutex_;
     std::vector<std::unique_ptr<ProducerThread>> producers_;
     std::vector<std::thread> threads_;
 };
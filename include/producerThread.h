@@ -5,18 +5,48 @@
 #include <vector>
 #include <atomic>
 #include <memory>
+#include <functional>
+#include <future>
+#include <deque>
 #include <grpcpp/grpcpp.h>
 #include "media_service.grpc.pb.h"
+#include "rateLimiter.h"
+#include "chunkSizer.h"
+#include "fileWorkQueue.h"
+#include "readAheadHasher.h"
+#include "shardRouter.h"
+#include "tracer.h"
+
+class InputFile;
 
 using grpc::Channel;
 using grpc::ClientContext;
 using grpc::ClientWriter;
 using grpc::Status;
 
+// Settings shared by every producer thread of a client
+struct ProducerOptions {
+    uint64_t producer_rate = 0;  // bytes/sec per producer, 0 = unlimited
+    uint64_t global_rate = 0;    // bytes/sec across all producers, 0 = unlimited
+    bool pause_between_files = true;  // random 2-5 s wait after each file
+    size_t min_chunk_size = 16 * 1024;   // adaptive chunk size bounds;
+    size_t max_chunk_size = 1024 * 1024; // equal bounds give fixed chunks
+    int channels = 1;                    // connections to the server
+    FileWorkQueue::Mode queue_mode = FileWorkQueue::Mode::PerDirectory;
+    bool watch = false;        // keep running and upload files as they land
+    std::string ledger_path;   // record of delivered files, empty = none
+    std::string journal_path;  // failed uploads to retry, empty = this run only
+    double trace_rate = Tracer::DEFAULT_SAMPLE_RATE;  // share of uploads traced
+};
+
 class ProducerThread {
 public:
-    ProducerThread(int id, const std::string& input_dir,
-                  std::shared_ptr<Channel> channel);
+    // work_queue, shards and global_limiter are shared by all producers
+    // of the client
+    ProducerThread(int id, std::shared_ptr<FileWorkQueue> work_queue,
+                  std::shared_ptr<ShardRouter> shards,
+                  const ProducerOptions& options,
+                  std::shared_ptr<RateLimiter> global_limiter);
 
     void run();
     void stop();
@@ -24,24 +54,83 @@ public:
     int getUploadedCount() const { return uploaded_count_; }
     int getFailedCount() const { return failed_count_; }
 
+    // Upper bound for chunk sizes; the server accepts messages up to 16 MB
+    static constexpr size_t MAX_CHUNK_SIZE = 8 * 1024 * 1024;
+
 private:
-    static constexpr size_t CHUNK_SIZE = 64 * 1024; // 64KB chunks
+    static constexpr size_t INITIAL_CHUNK_SIZE = 64 * 1024;
+    static constexpr size_t PROGRESS_INTERVAL = 640 * 1024; // bytes between progress lines
+    static constexpr size_t READ_AHEAD_SIZE = 4 * 1024 * 1024;
+    static constexpr size_t PIPELINE_DEPTH = 3;  // chunks the read-ahead may run in front
+
+    // A framed upload whose data is all sent, waiting for the server's reply
+    struct PendingUpload {
+        ChannelPool::Lease lease;
+        FileTask task;
+        int shard = 0;
+        bool failover = false;     // sent to a replica, its own shard was down
+        std::string filename;
+        ClientContext context;
+        mediaupload::UploadResponse response;
+        std::unique_ptr<ClientWriter<mediaupload::UploadFrame>> writer;
+        std::future<Status> status;
+        uint64_t trace_id = 0;     // 0 = not traced
+        int64_t wait_start_us = 0; // waiting for a queue slot, for the trace
+        int64_t wait_end_us = 0;
+    };
 
     std::string generateVideoId();
-    bool isVideoFile(const std::string& filename);
-    std::vector<std::string> getVideoFiles();
     std::string formatFileSize(size_t size);
-    bool uploadVideo(const std::string& filepath);
-    bool checkQueueStatus();  // BONUS: Check if server queue is full
+    // Returns false if the upload failed; a framed upload that was sent
+    // completely counts as done, its result is reported once it arrives
+    bool uploadVideo(const FileTask& task);
+    // Upload streams: one header frame then data-only frames, or the legacy
+    // stream that repeats the metadata in every chunk (servers without
+    // UploadVideoFrames). sendFrames leaves the reply to pending_.
+    // content_hash is the file's SHA-256 if already known, else empty
+    bool sendFrames(const InputFile& file, const std::string& video_id,
+                    uint64_t credit_id, const std::string& content_hash,
+                    std::unique_ptr<PendingUpload> upload);
+    Status sendChunks(ChannelPool::Lease& lease,
+                      const InputFile& file, const std::string& video_id,
+                      const std::string& filename, uint64_t trace_id,
+                      mediaupload::UploadResponse* response);
+    // Reads the file into *buffer (the outgoing message's data field) in
+    // pieces sized by chunk_sizer_, calling write_chunk(size, is_last)
+    // after each; with `hash` the read-ahead computes its SHA-256 on the way.
+    // False if a write fails or the file shrinks.
+    bool streamFile(const InputFile& file, bool hash, std::string* buffer,
+                    const std::function<bool(size_t, bool)>& write_chunk);
+    bool checkQueueStatus(int shard);  // BONUS: Check if server queue is full
+    // Waits for the reply to pending_, if any, and reports it
+    void finishPending();
+    // Reports the reply, or queues the file for the legacy stream if the
+    // server has no UploadVideoFrames
+    bool handleFramedResult(PendingUpload& upload, const Status& status);
+    // Uploads the files queued by handleFramedResult on the legacy stream
+    void sendFallbacks();
+    // Reports the final outcome of the file to the log and the work queue
+    bool reportResult(const FileTask& task, int shard, bool failover, const Status& status,
+                      const mediaupload::UploadResponse& response);
+    // Hands the outcome to the work queue, which may schedule a retry
+    void finishTask(const FileTask& task, UploadOutcome outcome);
 
     int producer_id_;
-    std::string input_dir_;
-    std::shared_ptr<Channel> channel_;
-    std::unique_ptr<mediaupload::MediaUploadService::Stub> stub_;
+    std::shared_ptr<FileWorkQueue> work_queue_;
+    std::shared_ptr<ShardRouter> shards_;
+    ProducerOptions options_;
+    RateLimiter rate_limiter_;
+    std::shared_ptr<RateLimiter> global_limiter_;
+    ChunkSizer chunk_sizer_;  // carries what it learned over to the next file
+    ReadAheadHasher read_ahead_;
+    std::unique_ptr<PendingUpload> pending_;
+    std::deque<FileTask> fallback_;  // framed uploads the server refused as UNIMPLEMENTED
     
     std::atomic<bool> running_;
+    bool use_upload_frames_;  // cleared once the server reports UNIMPLEMENTED
     std::atomic<int> uploaded_count_;
     std::atomic<int> failed_count_;
+    int taken_count_;  // files uploaded from another producer's directory
 };
 
 #endif // PRODUCER_THREAD_H
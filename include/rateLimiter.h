@@ -0,0 +1,34 @@
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <mutex>
+
+// Token bucket limiting a byte stream to a fixed rate. One instance may be
+// shared by several threads; a rate of 0 means unlimited.
+class RateLimiter {
+public:
+    explicit RateLimiter(uint64_t bytes_per_sec = 0);
+
+    // Blocks until `bytes` more may be sent. Callers reserve their bytes up
+    // front, so a request larger than the bucket simply waits longer.
+    void acquire(size_t bytes);
+
+    uint64_t rate() const { return bytes_per_sec_; }
+    bool isUnlimited() const { return bytes_per_sec_ == 0; }
+
+private:
+    // The bucket holds at most this much traffic, which bounds the burst
+    // after an idle period
+    static constexpr double BURST_SECONDS = 0.05;
+
+    uint64_t bytes_per_sec_;
+    double capacity_;
+    double tokens_;
+    std::chrono::steady_clock::time_point last_refill_;
+    std::mutex mutex_;
+};
+
+#endif // RATE_LIMITER_H
@@ -0,0 +1,62 @@
+#ifndef READ_AHEAD_HASHER_H
+#define READ_AHEAD_HASHER_H
+
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <cstddef>
+
+class InputFile;
+typedef struct evp_md_ctx_st EVP_MD_CTX;
+
+// Per-producer read-ahead stage. A background thread reads the file in
+// front of the sender, pulling it into the page cache and feeding it to
+// SHA-256, but never more than `window` bytes past what has been sent.
+// The sender waits for a range before writing it, so disk reads overlap
+// network writes instead of stalling them, and the file's hash is ready
+// as soon as its last chunk is.
+class ReadAheadHasher {
+public:
+    explicit ReadAheadHasher(size_t window);
+    ~ReadAheadHasher();
+
+    ReadAheadHasher(const ReadAheadHasher&) = delete;
+    ReadAheadHasher& operator=(const ReadAheadHasher&) = delete;
+
+    // Starts on a new file; the previous one is abandoned if unfinished
+    void start(const InputFile& file, bool hash);
+    // Blocks until [0, end) has been read and hashed, then lets the
+    // read-ahead move on to [end, end + window). False if the file shrank
+    // before `end` and the rest of it cannot be read.
+    bool waitFor(size_t end);
+    // Hex SHA-256 of the whole file; blocks until it has all been read
+    std::string digest();
+    // Stops reading the current file
+    void cancel();
+
+private:
+    static constexpr size_t HASH_STEP = 256 * 1024;
+
+    void run();
+
+    size_t window_;
+    const InputFile* file_;
+    size_t hashed_;     // bytes read and hashed so far
+    size_t released_;   // the sender is done with everything before this
+    bool active_;
+    bool hashing_;
+    bool busy_;         // the worker is hashing outside the lock
+    bool truncated_;    // the file shrank since it was opened; reading stopped
+    bool stopping_;
+    std::string digest_;
+
+    EVP_MD_CTX* sha_;
+    std::vector<char> buffer_;  // one step, used by the worker only
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::thread thread_;
+};
+
+#endif // READ_AHEAD_HASHER_H
@@ -0,0 +1,84 @@
+#ifndef RETRY_JOURNAL_H
+#define RETRY_JOURNAL_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <random>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+
+// How an upload ended, as far as retrying it is concerned
+enum class UploadOutcome {
+    Delivered,
+    Capacity,   // server queue full or RESOURCE_EXHAUSTED: back off longer
+    Transient,  // connection or stream errors: worth a quick retry
+    Permanent   // retrying cannot help (file gone, request rejected)
+};
+
+// On-disk list of uploads waiting to be retried, so a failed file is
+// never lost: not when the retries run out and not when the client
+// stops. The file is an append-only log of "retry <due_ms> <owner> <path>"
+// and "done <path>" lines, compacted whenever it is opened.
+//
+// Each failure pushes the next attempt out with jittered exponential
+// backoff, on a separate schedule for capacity and transient failures.
+class RetryJournal {
+public:
+    struct Entry {
+        std::string path;
+        int owner;
+        int64_t due_ms;  // wall clock, milliseconds since the epoch
+    };
+
+    RetryJournal() = default;
+    ~RetryJournal();
+
+    RetryJournal(const RetryJournal&) = delete;
+    RetryJournal& operator=(const RetryJournal&) = delete;
+
+    // Loads what an earlier run left, rewrites it compacted and appends
+    // from then on. Without a file the journal still schedules retries.
+    bool open(const std::string& path);
+    // Entries found by open(), each starting a fresh round of attempts
+    std::vector<Entry> pending();
+
+    // Records a failed attempt and picks the delay before the next one.
+    // Returns false once this run has used up the attempts for the file;
+    // it then stays in the journal for the next start.
+    bool schedule(const std::string& path, int owner, UploadOutcome outcome,
+                  int& attempt, std::chrono::milliseconds& delay);
+    void remove(const std::string& path);
+
+    size_t size();
+
+private:
+    struct Policy {
+        std::chrono::milliseconds base;
+        std::chrono::milliseconds cap;
+        int max_attempts;
+    };
+
+    static constexpr Policy CAPACITY_POLICY{std::chrono::seconds(2), std::chrono::seconds(30), 20};
+    static constexpr Policy TRANSIENT_POLICY{std::chrono::milliseconds(500), std::chrono::seconds(60), 8};
+    static constexpr size_t COMPACT_MIN_RECORDS = 1024;
+
+    void append(const std::string& line);
+    void compact();
+
+    struct State {
+        Entry entry;
+        int attempts = 0;
+    };
+
+    std::string path_;
+    std::unordered_map<std::string, State> entries_;
+    std::mutex mutex_;
+    std::mt19937 rng_{std::random_device{}()};
+    FILE* file_ = nullptr;
+    size_t records_ = 0;  // lines in the file, live or not
+};
+
+#endif // RETRY_JOURNAL_H
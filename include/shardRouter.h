@@ -0,0 +1,77 @@
+#ifndef SHARD_ROUTER_H
+#define SHARD_ROUTER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include "channelPool.h"
+#include "uploadCredits.h"
+
+// Spreads uploads over several consumer_server instances. Each file goes
+// to the shard its content hash lands on in a consistent-hash ring, so a
+// file's duplicates always reach the same server and are caught there,
+// and adding a shard moves only about 1/N of the files. A shard that
+// fails an upload is skipped for a while; its files go to the next shard
+// on the ring, and the first file after the pause probes it again.
+class ShardRouter {
+public:
+    static constexpr int VIRTUAL_NODES = 128;    // ring points per shard
+    static constexpr int RETRY_AFTER_MS = 5000;  // how long a failed shard is skipped
+
+    struct ShardStats {
+        std::string address;
+        bool healthy;
+        int uploads;      // files delivered
+        uint64_t bytes;
+        int failures;     // uploads that failed with a connection error
+        int failovers;    // files delivered here because their own shard was down
+    };
+
+    // One shard per address, each with its own channels and credits
+    ShardRouter(const std::vector<std::string>& addresses, int channels_per_shard);
+    // A single shard over channels made elsewhere
+    ShardRouter(const std::string& name, std::shared_ptr<ChannelPool> channels);
+
+    int size() const { return static_cast<int>(shards_.size()); }
+    ChannelPool& channels(int shard) { return *shards_[shard]->channels; }
+    UploadCredits& credits(int shard) { return *shards_[shard]->credits; }
+    const std::string& address(int shard) const { return shards_[shard]->address; }
+
+    // The shard for a file with this hex SHA-256: its own shard if that
+    // one is healthy, else the next healthy one on the ring. `failover`
+    // is set when that is not the file's own shard.
+    int pick(const std::string& content_hash, bool& failover);
+
+    // Outcome of an upload sent to the shard; `reachable` is false for
+    // connection errors, which take the shard out for RETRY_AFTER_MS
+    void recordResult(int shard, bool reachable, bool delivered, uint64_t bytes,
+                      bool failover);
+
+    std::vector<ShardStats> getStatistics() const;
+    void stop();
+
+private:
+    struct Shard {
+        std::string address;
+        std::shared_ptr<ChannelPool> channels;
+        std::unique_ptr<UploadCredits> credits;
+        std::atomic<int64_t> down_until_ms{0};  // steady clock
+        std::atomic<int> uploads{0};
+        std::atomic<uint64_t> bytes{0};
+        std::atomic<int> failures{0};
+        std::atomic<int> failovers{0};
+    };
+
+    void addShard(const std::string& address, std::shared_ptr<ChannelPool> channels);
+    bool isHealthy(const Shard& shard, int64_t now_ms) const;
+    static uint64_t ringPosition(const std::string& text);
+    static int64_t nowMs();
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::vector<std::pair<uint64_t, int>> ring_;  // (position, shard), sorted
+};
+
+#endif // SHARD_ROUTER_H
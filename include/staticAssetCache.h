@@ -0,0 +1,55 @@
+#ifndef STATIC_ASSET_CACHE_H
+#define STATIC_ASSET_CACHE_H
+
+#include <string>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+
+// A web asset held fully in memory, with precompressed variants
+struct StaticAsset {
+    std::string content_type;
+    std::string cache_control;
+    std::string etag;       // strong ETag of the identity body, quoted
+    std::string identity;
+    std::string gzip;       // empty if compression doesn't pay off
+    std::string brotli;     // empty if compression doesn't pay off or unavailable
+};
+
+class StaticAssetCache {
+public:
+    explicit StaticAssetCache(const std::string& web_root);
+    ~StaticAssetCache();
+
+    // (Re)loads every file below web_root; safe to call while serving
+    void load();
+    // Reloads the cache whenever web_root changes (inotify, Linux only)
+    void startWatching();
+    void stop();
+
+    // Looks up a request path such as "/index.html"; nullptr if unknown
+    std::shared_ptr<const StaticAsset> find(const std::string& path) const;
+
+    static std::string contentTypeFor(const std::string& path);
+
+private:
+    using AssetMap = std::unordered_map<std::string, std::shared_ptr<const StaticAsset>>;
+
+    static constexpr int RELOAD_DEBOUNCE_MS = 100;
+
+    std::shared_ptr<const StaticAsset> loadAsset(const std::string& file_path,
+                                                 const std::string& url_path);
+    void watchLoop();
+
+    std::string web_root_;
+    std::shared_ptr<const AssetMap> assets_;
+    mutable std::mutex assets_mutex_;
+
+    std::atomic<bool> running_;
+    std::thread watch_thread_;
+    int inotify_fd_;
+};
+
+#endif // STATIC_ASSET_CACHE_H
@@ -0,0 +1,105 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+// Span tracing for sampled uploads. Each sampled upload gets a trace id,
+// which the producer sends to the server in gRPC metadata; the server
+// then times every stage of that upload (receive, hash, enqueue, queue
+// wait, write, thumbnail) and keeps the spans in a fixed-size ring.
+// Uploads that are not sampled have trace id 0 and cost nothing beyond
+// the sampling decision. toJson() exports the Chrome trace event format,
+// which chrome://tracing and ui.perfetto.dev open directly.
+class Tracer {
+public:
+    static constexpr const char* METADATA_KEY = "x-trace-id";
+    static constexpr size_t DEFAULT_CAPACITY = 64 * 1024;  // spans kept
+    static constexpr double DEFAULT_SAMPLE_RATE = 0.01;
+
+    // Chrome trace "processes": the server's own threads, and producers
+    // (one track per producer id) whose spans arrive with their uploads
+    enum Process {
+        Consumer = 1,
+        Producer = 2
+    };
+
+    explicit Tracer(double sample_rate = DEFAULT_SAMPLE_RATE,
+                    size_t capacity = DEFAULT_CAPACITY);
+
+    void setSampleRate(double rate) { sample_rate_ = rate; }
+    double sampleRate() const { return sample_rate_; }
+
+    // A new trace id with probability `rate`, otherwise 0
+    static uint64_t sample(double rate);
+    uint64_t sample() { return sample(sample_rate_); }
+
+    // Microseconds on the system clock, comparable between processes
+    static int64_t nowMicros();
+
+    static std::string formatId(uint64_t trace_id);
+    static uint64_t parseId(const std::string& text);  // 0 if invalid
+
+    // Records [start_us, end_us) for the upload. Consumer spans go on the
+    // calling thread's track; Producer spans on track `producer_id`.
+    void record(uint64_t trace_id, const std::string& video_id, const char* name,
+                int64_t start_us, int64_t end_us,
+                Process process = Consumer, int producer_id = 0);
+
+    size_t size();
+    std::string toJson();
+
+private:
+    struct Span {
+        uint64_t trace_id;
+        std::string video_id;
+        std::string name;
+        Process process;
+        int thread;
+        int64_t start_us;
+        int64_t duration_us;
+    };
+
+    int threadTrack();
+
+    std::atomic<double> sample_rate_;
+    size_t capacity_;
+    std::mutex mutex_;
+    std::vector<Span> spans_;  // ring, oldest at next_ once full
+    size_t next_;
+    std::unordered_map<int, std::string> thread_names_;
+};
+
+// Times one span of a traced upload, from construction until end() or
+// destruction. Does nothing, and reads no clock, when trace_id is 0.
+class TraceScope {
+public:
+    TraceScope(Tracer& tracer, uint64_t trace_id, const std::string& video_id,
+               const char* name)
+        : tracer_(tracer), trace_id_(trace_id), video_id_(video_id), name_(name),
+          start_us_(trace_id ? Tracer::nowMicros() : 0) {}
+    ~TraceScope() { end(); }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    void end() {
+        if (trace_id_) {
+            tracer_.record(trace_id_, video_id_, name_, start_us_, Tracer::nowMicros());
+            trace_id_ = 0;
+        }
+    }
+
+private:
+    Tracer& tracer_;
+    uint64_t trace_id_;
+    const std::string& video_id_;
+    const char* name_;
+    int64_t start_us_;
+};
+
+#endif // TRACER_H
@@ -0,0 +1,66 @@
+#ifndef UPLOAD_CREDITS_H
+#define UPLOAD_CREDITS_H
+
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <cstdint>
+#include <grpcpp/grpcpp.h>
+#include "media_service.grpc.pb.h"
+#include "channelPool.h"
+
+// Client side of the Subscribe stream. Producers ask for one credit per
+// file and block until the server grants it, which it does as soon as a
+// queue slot is free, so uploads are never dropped for a full queue and
+// nobody polls GetQueueStatus. One subscription is shared by all
+// producers of a client.
+//
+// A stream that breaks (server restarted, or not up yet) is opened again
+// with backoff; producers poll the queue status in the meantime. Only a
+// server without Subscribe ends it for good.
+class UploadCredits {
+public:
+    static constexpr int MIN_RECONNECT_MS = 500;
+    static constexpr int MAX_RECONNECT_MS = 5000;
+
+    explicit UploadCredits(ChannelPool::Stub* stub);
+    ~UploadCredits();
+
+    UploadCredits(const UploadCredits&) = delete;
+    UploadCredits& operator=(const UploadCredits&) = delete;
+
+    // Blocks until a credit is granted. Returns false while there is no
+    // stream (stopped, reconnecting, or a server too old to know
+    // Subscribe); callers then fall back to polling the queue status.
+    bool acquire();
+    // Identifies the subscription in upload headers so the server can
+    // redeem the credit
+    uint64_t subscriptionId();
+    void stop();
+
+private:
+    using Stream = grpc::ClientReaderWriter<mediaupload::CreditRequest,
+                                            mediaupload::CreditGrant>;
+
+    // Opens the stream, reads grants until it breaks, and opens it again
+    void run();
+    // False when the stream should not be opened again
+    bool readGrants(Stream& stream);
+
+    ChannelPool::Stub* stub_;
+    std::mutex write_mutex_;  // Write() must not be called concurrently; guards stream_
+    std::shared_ptr<Stream> stream_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::unique_ptr<grpc::ClientContext> context_;  // of the current stream; guarded by mutex_
+    int available_;
+    uint64_t subscription_id_;
+    bool connected_;  // a stream is open
+    uint64_t disconnects_;
+    bool stopping_;
+    std::thread reader_;
+};
+
+#endif // UPLOAD_CREDITS_H
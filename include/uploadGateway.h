@@ -0,0 +1,88 @@
+#ifndef UPLOAD_GATEWAY_H
+#define UPLOAD_GATEWAY_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <grpcpp/grpcpp.h>
+#include "media_service.grpc.pb.h"
+#include "consumerServer.h"
+
+// consumer_server's gateway mode (-b): a stateless front door for a pool
+// of backend consumer servers. Each upload stream is passed on message
+// by message to the backend with the most free queue slots, so nothing
+// is buffered here beyond the message in hand and producers keep one
+// address while backends are added behind it. Queue status and
+// statistics are the sums over the pool.
+class UploadGateway final : public MediaUploadService::Service {
+public:
+    static constexpr int POLL_INTERVAL_MS = 250;  // backend GetQueueStatus period
+
+    explicit UploadGateway(const std::vector<std::string>& backend_addresses);
+    ~UploadGateway();
+
+    Status UploadVideo(ServerContext* context,
+                       ServerReader<VideoChunk>* reader,
+                       UploadResponse* response) override;
+
+    Status UploadVideoFrames(ServerContext* context,
+                             ServerReader<UploadFrame>* reader,
+                             UploadResponse* response) override;
+
+    // Credits are per backend and a producer can't know which backend its
+    // next upload goes to; producers fall back to GetQueueStatus
+    Status Subscribe(ServerContext* context,
+                     ServerReaderWriter<CreditGrant, CreditRequest>* stream) override;
+
+    Status GetQueueStatus(ServerContext* context,
+                          const QueueStatusRequest* request,
+                          QueueStatusResponse* response) override;
+
+    Status GetStatistics(ServerContext* context,
+                         const StatisticsRequest* request,
+                         StatisticsResponse* response) override;
+
+    // Polls the backends now and then every POLL_INTERVAL_MS
+    void start();
+    void stop();  // prints the statistics
+    void printStatistics();
+
+private:
+    using Stub = mediaupload::MediaUploadService::Stub;
+
+    struct Backend {
+        std::string address;
+        std::unique_ptr<Stub> stub;
+        // From the last poll; guarded by mutex_
+        bool reachable = false;
+        int free_slots = 0;
+        int max_size = 0;
+        int queue_size = 0;
+        int pending = 0;  // picked, but not in free_slots yet
+        std::atomic<int> active{0};
+        std::atomic<int> uploads{0};
+        std::atomic<int> failures{0};
+    };
+
+    // The reachable backend with the most free slots, -1 if none has any
+    int pickBackend();
+    void finishUpload(int backend, const Status& status, const UploadResponse& response);
+    void pollBackends();
+    void poll();
+    // The producer's trace id goes along to the backend
+    static void copyMetadata(const ServerContext* from, grpc::ClientContext& to);
+
+    std::vector<std::unique_ptr<Backend>> backends_;
+    std::mutex mutex_;
+    std::condition_variable stop_cv_;
+    bool running_;
+    std::thread poller_;
+    std::atomic<int> rejected_;  // uploads refused because the whole pool was full
+};
+
+#endif // UPLOAD_GATEWAY_H
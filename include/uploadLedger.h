@@ -0,0 +1,55 @@
+#ifndef UPLOAD_LEDGER_H
+#define UPLOAD_LEDGER_H
+
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include <cstdio>
+#include <cstdint>
+
+// On-disk record of the files a producer client has delivered, so a
+// restarted client does not send them again. Each line of the file is
+// "<size> <mtime> <path>"; a file that is rewritten in place gets a new
+// size or mtime and is uploaded again.
+//
+// A file is claimed when it is queued and committed once the server has
+// it, so a file seen by both the startup scan and the directory watcher
+// is only uploaded once.
+class UploadLedger {
+public:
+    UploadLedger() = default;
+    ~UploadLedger();
+
+    UploadLedger(const UploadLedger&) = delete;
+    UploadLedger& operator=(const UploadLedger&) = delete;
+
+    // Loads the record from path and appends to it from then on
+    bool open(const std::string& path);
+
+    // False if this version of the file was uploaded or is already claimed
+    bool claim(const std::string& path, uint64_t size, int64_t mtime);
+    // The server has the claimed file; appends it to the record
+    void commit(const std::string& path);
+    // The upload failed; the file may be claimed again
+    void release(const std::string& path);
+    // Whether the file is queued, in flight or waiting for a retry
+    bool isClaimed(const std::string& path);
+
+    size_t uploadedCount();
+
+private:
+    struct Entry {
+        uint64_t size;
+        int64_t mtime;
+        bool operator==(const Entry& other) const {
+            return size == other.size && mtime == other.mtime;
+        }
+    };
+
+    std::unordered_map<std::string, Entry> uploaded_;
+    std::unordered_map<std::string, Entry> claimed_;
+    std::mutex mutex_;
+    FILE* file_ = nullptr;
+};
+
+#endif // UPLOAD_LEDGER_H
@@ -3,7 +3,15 @@
 
 #include <string>
 #include <thread>
+#include <unordered_map>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <unordered_set>
 #include "consumerServer.h"
+#include "staticAssetCache.h"
 
 #ifdef _WIN32
     #include <winsock2.h>
@@ -12,34 +20,107 @@
     typedef int SOCKET;
 #endif
 
+struct HttpRequest {
+    std::string method;
+    std::string path;
+    std::string query;      // everything after '?', not decoded
+    std::string version;
+    std::unordered_map<std::string, std::string> headers; // lower-case names
+    std::string body;
+    bool keep_alive = false;
+
+    std::string header(const std::string& name) const;
+    std::string queryParam(const std::string& name) const;
+};
+
 class WebServer {
 public:
-    WebServer(int port, ConsumerServer* consumer_server, 
-              const std::string& web_root);
+    // max_events_per_sec caps how often /api/events pushes to each dashboard
+    WebServer(int port, ConsumerServer* consumer_server,
+              const std::string& web_root, int max_events_per_sec = 4);
     ~WebServer();
 
+    // CPUs for the accept loop and connection threads; call before start()
+    void setCpus(const std::vector<int>& cpus) { cpus_ = cpus; }
+
     void start();
+    // Closes the listening socket and every open connection, and returns
+    // once all connection threads are done
     void stop();
 
 private:
+    // Lets server_microbench time getVideosJson without a network
+    friend struct WebServerBenchAccess;
+
+    static constexpr size_t MAX_HEADER_SIZE = 64 * 1024;
+    static constexpr size_t MAX_BODY_SIZE = 1024 * 1024;
+    static constexpr int IDLE_TIMEOUT_SEC = 15;
+    static constexpr int MAX_REQUESTS_PER_CONNECTION = 1000;
+    static constexpr size_t SENDFILE_CHUNK_SIZE = 1024 * 1024;
+    static constexpr size_t VIDEOS_JSON_SEGMENT_SIZE = 256 * 1024;
+    static constexpr int EVENT_HEARTBEAT_SEC = 15;
+
+    enum class ParseResult {
+        Complete,
+        Incomplete,
+        Invalid,
+        Unsupported,
+        HeadersTooLarge,
+        BodyTooLarge
+    };
+
     void run();
-    void handleRequest(SOCKET client_fd);
-    void handleApiRequest(SOCKET client_fd, const std::string& method, 
-                         const std::string& path);
-    void handleFileRequest(SOCKET client_fd, const std::string& path);
-    void sendResponse(SOCKET client_fd, int status_code, 
-                     const std::string& content_type,
-                     const std::string& body);
+    void handleConnection(SOCKET client_fd);
+    ParseResult parseRequest(const std::string& buffer, HttpRequest& request,
+                             size_t& consumed);
+    bool handleRequest(SOCKET client_fd, const HttpRequest& request);
+    void handleApiRequest(SOCKET client_fd, const HttpRequest& request);
+    void handleVideosRequest(SOCKET client_fd, const HttpRequest& request);
+    void handleEventStream(SOCKET client_fd, const HttpRequest& request);
+    void handleFileRequest(SOCKET client_fd, const HttpRequest& request);
+    void serveAsset(SOCKET client_fd, const HttpRequest& request,
+                    const StaticAsset& asset);
+    void serveFile(SOCKET client_fd, const HttpRequest& request,
+                   const std::string& file_path,
+                   const std::string& content_type);
+    bool sendFileRange(SOCKET client_fd, const std::string& file_path,
+                       size_t offset, size_t length);
+    std::string buildHeaders(const HttpRequest& request, int status_code,
+                             const std::string& content_type,
+                             size_t content_length,
+                             const std::string& extra_headers);
+    void sendResponse(SOCKET client_fd, const HttpRequest& request,
+                     int status_code, const std::string& content_type,
+                     const std::string& body,
+                     const std::string& extra_headers = "");
+    bool sendAll(SOCKET client_fd, const char* data, size_t length);
 
     std::string getStatisticsJson();
     std::string getQueueStatusJson();
-    std::string getVideosJson();
+    std::string queueStatusToJson(const ServerStatistics& stats);
+    std::vector<std::shared_ptr<const std::string>> getVideosJson(uint64_t& version);
 
     int port_;
     ConsumerServer* consumer_server_;
     std::string web_root_;
-    bool running_;
+    StaticAssetCache asset_cache_;
+    int max_events_per_sec_;
+    std::vector<int> cpus_;  // empty = anywhere
+    std::atomic<bool> running_;
     std::thread server_thread_;
+    std::atomic<SOCKET> listen_fd_;  // closed by stop() to wake accept()
+
+    // Sockets of the running connection threads; stop() shuts them down
+    // and waits for the set to empty
+    std::mutex connections_mutex_;
+    std::condition_variable connections_cv_;
+    std::unordered_set<SOCKET> connections_;
+
+    // Serialized /api/videos entries in fixed-size segments, so adding
+    // metadata never re-serializes or copies what is already there
+    std::mutex videos_json_mutex_;
+    std::vector<std::shared_ptr<const std::string>> videos_json_segments_;
+    uint64_t videos_json_version_;
 };
 
 #endif // WEB_SERVER_H
\ No newline at end of file
@@ -0,0 +1,85 @@
+#!/bin/bash
+# Multi-process check of gateway mode (consumer_server -b): two backends
+# with different queue sizes behind one gateway, loaded by upload_bench.
+# Passes if every upload lands on a backend and the larger backend takes
+# the larger share while the small one is full.
+#
+#   scripts/test_gateway_rebalance.sh [build_dir]    (default: ./build)
+
+BUILD_DIR="${1:-build}"
+SERVER="$BUILD_DIR/consumer_server"
+BENCH="$BUILD_DIR/upload_bench"
+UPLOADS=60
+BASE_PORT=50160
+
+for binary in "$SERVER" "$BENCH"; do
+    if [ ! -x "$binary" ]; then
+        echo "Not built: $binary" >&2
+        exit 1
+    fi
+done
+command -v curl >/dev/null || { echo "curl is required" >&2; exit 1; }
+
+WORK_DIR=$(mktemp -d)
+PIDS=()
+cleanup() {
+    kill "${PIDS[@]}" 2>/dev/null
+    wait 2>/dev/null
+    rm -rf "$WORK_DIR"
+}
+trap cleanup EXIT
+
+# Backend 1: 2 slots and one consumer, so it fills up; backend 2: 16 slots
+"$SERVER" -c 1 -q 2 -p $((BASE_PORT + 1)) -w $((BASE_PORT + 11)) \
+    -o "$WORK_DIR/small" -L warn > "$WORK_DIR/small.log" 2>&1 &
+PIDS+=($!)
+"$SERVER" -c 4 -q 16 -p $((BASE_PORT + 2)) -w $((BASE_PORT + 12)) \
+    -o "$WORK_DIR/large" -L warn > "$WORK_DIR/large.log" 2>&1 &
+PIDS+=($!)
+"$SERVER" -b "localhost:$((BASE_PORT + 1)),localhost:$((BASE_PORT + 2))" -p $BASE_PORT \
+    -L warn > "$WORK_DIR/gateway.log" 2>&1 &
+PIDS+=($!)
+sleep 2
+
+"$BENCH" -s "localhost:$BASE_PORT" -n 8 -u $UPLOADS -z fixed:8M > "$WORK_DIR/bench.json" \
+    2> "$WORK_DIR/bench.log"
+if [ $? -ne 0 ]; then
+    echo "FAIL: upload_bench exited with an error" >&2
+    cat "$WORK_DIR/bench.log" >&2
+    exit 1
+fi
+
+# Let the consumers write out what they have queued
+sleep 2
+
+# One number from a flat JSON object
+field() {
+    grep -o "\"$2\": *[0-9]*" <<< "$1" | head -1 | grep -o '[0-9]*$'
+}
+
+bench=$(cat "$WORK_DIR/bench.json")
+succeeded=$(field "$bench" succeeded)
+small=$(field "$(curl -s "localhost:$((BASE_PORT + 11))/api/statistics")" total_received)
+large=$(field "$(curl -s "localhost:$((BASE_PORT + 12))/api/statistics")" total_received)
+small_files=$(ls "$WORK_DIR/small" | grep -c -v thumbnails)
+large_files=$(ls "$WORK_DIR/large" | grep -c -v thumbnails)
+
+echo "Uploads:   $UPLOADS sent, $succeeded succeeded"
+echo "Backend 1: $small received, $small_files written (queue 2)"
+echo "Backend 2: $large received, $large_files written (queue 16)"
+
+status=0
+if [ "$succeeded" -ne "$UPLOADS" ]; then
+    echo "FAIL: not every upload succeeded" >&2
+    status=1
+fi
+if [ $((small + large)) -ne "$UPLOADS" ] || [ $((small_files + large_files)) -ne "$UPLOADS" ]; then
+    echo "FAIL: the backends did not receive and write every upload" >&2
+    status=1
+fi
+if [ "$large" -le "$small" ]; then
+    echo "FAIL: the larger backend did not take the larger share" >&2
+    status=1
+fi
+[ $status -eq 0 ] && echo "PASS"
+exit $status
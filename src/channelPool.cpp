@@ -0,0 +1,72 @@
+#include "include/channelPool.h"
+
+ChannelPool::ChannelPool(const std::string& server_address, int size) {
+    for (int i = 0; i < size; i++) {
+        grpc::ChannelArguments args;
+        // Channels with identical args to the same target would share one
+        // subchannel, and with it one connection
+        args.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+        args.SetInt("media_upload.channel_index", i);
+
+        auto pooled = std::make_unique<PooledChannel>();
+        pooled->channel = grpc::CreateCustomChannel(server_address,
+                                                    grpc::InsecureChannelCredentials(),
+                                                    args);
+        pooled->stub = mediaupload::MediaUploadService::NewStub(pooled->channel);
+        channels_.push_back(std::move(pooled));
+    }
+}
+
+ChannelPool::ChannelPool(const std::vector<std::shared_ptr<grpc::Channel>>& channels) {
+    for (const auto& channel : channels) {
+        auto pooled = std::make_unique<PooledChannel>();
+        pooled->channel = channel;
+        pooled->stub = mediaupload::MediaUploadService::NewStub(channel);
+        channels_.push_back(std::move(pooled));
+    }
+}
+
+ChannelPool::Lease ChannelPool::acquire() {
+    // Not atomic as a whole; two threads may occasionally pick the same
+    // channel, which only costs a little balance
+    size_t best = 0;
+    for (size_t i = 1; i < channels_.size(); i++) {
+        if (channels_[i]->active < channels_[best]->active) {
+            best = i;
+        }
+    }
+    channels_[best]->active++;
+    channels_[best]->streams++;
+    return Lease(this, static_cast<int>(best));
+}
+
+std::vector<ChannelPool::ChannelStats> ChannelPool::getStatistics() const {
+    std::vector<ChannelStats> stats;
+    for (const auto& channel : channels_) {
+        stats.push_back({channel->streams.load(), channel->bytes.load()});
+    }
+    return stats;
+}
+
+ChannelPool::Lease::Lease(Lease&& other) noexcept
+    : pool_(other.pool_), index_(other.index_) {
+    other.pool_ = nullptr;
+}
+
+ChannelPool::Lease& ChannelPool::Lease::operator=(Lease&& other) noexcept {
+    if (this != &other) {
+        if (pool_) {
+            pool_->channels_[index_]->active--;
+        }
+        pool_ = other.pool_;
+        index_ = other.index_;
+        other.pool_ = nullptr;
+    }
+    return *this;
+}
+
+ChannelPool::Lease::~Lease() {
+    if (pool_) {
+        pool_->channels_[index_]->active--;
+    }
+}
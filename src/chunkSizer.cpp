@@ -0,0 +1,90 @@
+#include "include/chunkSizer.h"
+#include <algorithm>
+
+ChunkSizer::ChunkSizer(size_t min_size, size_t max_size, size_t initial_size)
+    : index_(0), windows_(0), probe_up_(true),
+      window_bytes_(0), window_writes_(0),
+      window_time_(std::chrono::steady_clock::duration::zero()) {
+    for (size_t size = min_size; size < max_size; size *= 2) {
+        sizes_.push_back(size);
+    }
+    sizes_.push_back(max_size);
+    throughput_.assign(sizes_.size(), 0);
+    limit_ = sizes_.size() - 1;
+
+    // Start from the candidate closest to the requested initial size
+    while (index_ + 1 < sizes_.size() && sizes_[index_] < initial_size) {
+        index_++;
+    }
+    chunk_size_ = sizes_[index_];
+}
+
+void ChunkSizer::select(size_t index) {
+    index_ = index;
+    chunk_size_ = sizes_[index];
+}
+
+size_t ChunkSizer::nextIndex() {
+    // Explore upwards first, then downwards, until both neighbours are known
+    if (index_ < limit_ && throughput_[index_ + 1] == 0) {
+        return index_ + 1;
+    }
+    if (index_ > 0 && throughput_[index_ - 1] == 0) {
+        return index_ - 1;
+    }
+
+    size_t best = 0;
+    for (size_t i = 1; i <= limit_; i++) {
+        if (throughput_[i] > throughput_[best]) {
+            best = i;
+        }
+    }
+
+    // Keep the neighbours' estimates fresh in case conditions change
+    if (++windows_ % PROBE_INTERVAL == 0) {
+        probe_up_ = !probe_up_;
+        if (probe_up_ && best < limit_) return best + 1;
+        if (!probe_up_ && best > 0) return best - 1;
+    }
+    return best;
+}
+
+void ChunkSizer::recordWrite(size_t bytes, std::chrono::steady_clock::duration elapsed) {
+    if (isFixed()) {
+        return;
+    }
+
+    window_bytes_ += bytes;
+    window_time_ += elapsed;
+    window_writes_++;
+    if (window_writes_ < WINDOW_WRITES || window_time_ < MIN_WINDOW) {
+        return;
+    }
+
+    double seconds = std::chrono::duration<double>(window_time_).count();
+    double throughput = window_bytes_ / seconds;
+    auto average_latency = window_time_ / window_writes_;
+
+    window_bytes_ = 0;
+    window_writes_ = 0;
+    window_time_ = std::chrono::steady_clock::duration::zero();
+
+    double& estimate = throughput_[index_];
+    estimate = estimate == 0 ? throughput
+                             : estimate * (1 - SMOOTHING) + throughput * SMOOTHING;
+
+    // Writes that block this long mean the link can't keep up anyway;
+    // smaller messages keep progress and cancellation responsive
+    if (average_latency > MAX_WRITE_LATENCY && index_ > 0) {
+        limit_ = index_ - 1;
+        select(limit_);
+        return;
+    }
+    if (index_ == limit_ && limit_ + 1 < sizes_.size() &&
+        average_latency < MAX_WRITE_LATENCY / 4) {
+        // Writes at the limit became fast again: allow the next size up
+        limit_++;
+    }
+
+    select(nextIndex());
+}
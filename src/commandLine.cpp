@@ -0,0 +1,43 @@
+#include "include/commandLine.h"
+#include <sstream>
+#include <exception>
+
+std::vector<std::string> splitAddresses(const std::string& list) {
+    std::vector<std::string> addresses;
+    std::istringstream entries(list);
+    std::string address;
+    while (std::getline(entries, address, ',')) {
+        if (!address.empty()) {
+            addresses.push_back(address);
+        }
+    }
+    return addresses;
+}
+
+bool parseQuantity(const std::string& text, double unit, uint64_t& result) {
+    size_t used = 0;
+    double value;
+    try {
+        value = std::stod(text, &used);
+    } catch (const std::exception&) {
+        return false;
+    }
+
+    std::string suffix = text.substr(used);
+    double scale = 1;
+    if (suffix == "K" || suffix == "k") {
+        scale = unit;
+    } else if (suffix == "M" || suffix == "m") {
+        scale = unit * unit;
+    } else if (suffix == "G" || suffix == "g") {
+        scale = unit * unit * unit;
+    } else if (!suffix.empty()) {
+        return false;
+    }
+
+    if (value < 0) {
+        return false;
+    }
+    result = static_cast<uint64_t>(value * scale);
+    return true;
+}
@@ -1,4 +1,5 @@
 #include "include/consumerServer.h"
+#include "include/logger.h"
 #include <iostream>
 #include <fstream>
 #include <filesystem>
@@ -6,8 +7,13 @@
 #include <chrono>
 #include <iomanip>
 #include <sstream>
+#include <algorithm>
 #include <openssl/sha.h>
 
+#ifdef __linux__
+    #include <pthread.h>
+#endif
+
 namespace fs = std::filesystem;
 
 ConsumerServer::ConsumerServer(int num_consumers, int max_queue_size, 
@@ -15,10 +21,20 @@ ConsumerServer::ConsumerServer(int num_consumers, int max_queue_size,
     : num_consumers_(num_consumers), 
       max_queue_size_(max_queue_size),
       output_dir_(output_dir),
+      processing_delay_(100),
+      spool_dir_((fs::path(output_dir) / ".spool").string()),
+      next_subscription_id_(1),
+      reserved_slots_(0),
+      numa_dispatch_(false),
+      next_rpc_node_(0),
       running_(true),
+      draining_(false),
+      metadata_version_(std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::system_clock::now().time_since_epoch()).count()),
       total_received_(0),
       total_dropped_(0),
-      total_duplicates_(0) {
+      total_duplicates_(0),
+      change_seq_(0) {
     
     // Create output directory if it doesn't exist
     if (!fs::exists(output_dir_)) {
@@ -41,6 +57,14 @@ Status ConsumerServer::UploadVideo(ServerContext* context,
     int producer_id = 0;
     size_t total_size = 0;
     int chunks_received = 0;
+    bool complete = false;
+    if (draining_) {
+        return Status(grpc::StatusCode::UNAVAILABLE, "Server is shutting down");
+    }
+    placeRpcThread();
+    uint64_t trace_id = traceIdFor(context);
+    TraceScope receive_span(tracer_, trace_id, video_id, "receive");
+    BudgetLease buffer_lease(memory_budget_);
 
     // Read all chunks
     while (reader->Read(&chunk)) {
@@ -50,40 +74,210 @@ Status ConsumerServer::UploadVideo(ServerContext* context,
             producer_id = chunk.producer_id();
             total_size = chunk.total_size();
             
-            std::cout << "\n[CONSUMER] Receiving video: " << filename 
-                      << " from Producer-" << producer_id << std::endl;
+            LOG_DEBUG("[CONSUMER] Receiving video: " << filename
+                      << " from Producer-" << producer_id);
+
+            if (!memory_budget_.admits(total_size)) {
+                return uploadTooLarge(filename, total_size);
+            }
+            // Not reading on while this waits is what pushes back on the producer
+            if (!buffer_lease.acquire(total_size, [context]() { return context->IsCancelled(); })) {
+                return Status(grpc::StatusCode::CANCELLED, "Upload cancelled");
+            }
         }
 
-        video_data.insert(video_data.end(), 
-                         chunk.data().begin(), 
-                         chunk.data().end());
+        // Only the announced size is reserved, so nothing past it is taken in
+        if (video_data.size() + chunk.data().size() > total_size) {
+            return oversizedUpload(filename, total_size);
+        }
+        appendChunk(video_data, chunk.data());
         chunks_received++;
 
         if (chunk.is_last()) {
-            std::cout << "[CONSUMER] Received final chunk #" << chunks_received 
-                      << " for " << filename << std::endl;
+            LOG_DEBUG("[CONSUMER] Received final chunk #" << chunks_received
+                      << " for " << filename);
+            complete = true;
+            break;
+        }
+    }
+
+    receive_span.end();
+    if (!complete || video_data.size() != total_size) {
+        return incompleteUpload(context, filename, video_data.size(), total_size);
+    }
+    return acceptUpload(video_id, filename, producer_id, total_size, "", 0, trace_id,
+                        std::move(video_data), response);
+}
+
+Status ConsumerServer::UploadVideoFrames(ServerContext* context,
+                                         ServerReader<UploadFrame>* reader,
+                                         UploadResponse* response) {
+    UploadFrame frame;
+    std::vector<char> video_data;
+    std::string video_id;
+    std::string filename;
+    int producer_id = 0;
+    size_t total_size = 0;
+    std::string expected_hash;
+    CreditClaim credit(*this);
+    bool have_header = false;
+    bool complete = false;
+    int frames_received = 0;
+    if (draining_) {
+        return Status(grpc::StatusCode::UNAVAILABLE, "Server is shutting down");
+    }
+    placeRpcThread();
+    uint64_t trace_id = traceIdFor(context);
+    TraceScope receive_span(tracer_, trace_id, video_id, "receive");
+    BudgetLease buffer_lease(memory_budget_);
+
+    // The header frame carries the metadata; everything after it is data
+    while (reader->Read(&frame)) {
+        if (frame.has_header()) {
+            // The memory lease and the size checks rest on the first
+            // header's total_size, so it may not be replaced
+            if (have_header) {
+                return Status(grpc::StatusCode::INVALID_ARGUMENT, "Duplicate upload header");
+            }
+            const auto& header = frame.header();
+            video_id = header.video_id();
+            filename = header.filename();
+            producer_id = header.producer_id();
+            total_size = header.total_size();
+            credit.claim(header.credit_id());
+            have_header = true;
+
+            LOG_DEBUG("[CONSUMER] Receiving video: " << filename
+                      << " from Producer-" << producer_id);
+            if (!memory_budget_.admits(total_size)) {
+                return uploadTooLarge(filename, total_size);
+            }
+        } else if (frame.frame_case() == UploadFrame::kData) {
+            if (!have_header) {
+                return Status(grpc::StatusCode::INVALID_ARGUMENT,
+                              "Data frame received before upload header");
+            }
+            // Reserved once the data starts, not at the header: a producer
+            // sends the next header before it collects the previous reply,
+            // so holding memory for a stream with no data yet could deadlock.
+            // Not reading on while this waits is what pushes back on the producer.
+            if (frames_received == 0 &&
+                !buffer_lease.acquire(total_size, [context]() { return context->IsCancelled(); })) {
+                return Status(grpc::StatusCode::CANCELLED, "Upload cancelled");
+            }
+            // Only the announced size is reserved, so nothing past it is taken in
+            if (video_data.size() + frame.data().size() > total_size) {
+                return oversizedUpload(filename, total_size);
+            }
+            appendChunk(video_data, frame.data());
+            frames_received++;
+        }
+
+        if (frame.is_last()) {
+            expected_hash = frame.sha256();
+            // What the producer timed on its side of a traced upload
+            if (trace_id) {
+                for (const auto& span : frame.spans()) {
+                    tracer_.record(trace_id, video_id, span.name().c_str(), span.start_us(),
+                                   span.start_us() + span.duration_us(),
+                                   Tracer::Producer, producer_id);
+                }
+            }
+            LOG_DEBUG("[CONSUMER] Received final frame #" << frames_received
+                      << " for " << filename);
+            complete = true;
             break;
         }
     }
 
+    receive_span.end();
+    // The checksum only comes with the last frame, so a stream cut off
+    // before it can't be verified and is at best a prefix of the file
+    if (!complete || video_data.size() != total_size) {
+        return incompleteUpload(context, filename, video_data.size(), total_size);
+    }
+    return acceptUpload(video_id, filename, producer_id, total_size, expected_hash,
+                        credit.take(), trace_id, std::move(video_data), response);
+}
+
+Status ConsumerServer::incompleteUpload(ServerContext* context, const std::string& filename,
+                                        size_t received, size_t total_size) {
+    if (context->IsCancelled()) {
+        LOG_WARN("[CONSUMER] ⚠️  Upload of " << filename << " cancelled after "
+                 << received << " of " << total_size << " bytes, discarded");
+        return Status(grpc::StatusCode::CANCELLED, "Upload cancelled");
+    }
+    LOG_WARN("[CONSUMER] ⚠️  Upload of " << filename << " ended after " << received
+             << " of " << total_size << " bytes without its last message, discarded");
+    return Status(grpc::StatusCode::DATA_LOSS, "Upload ended before its last message");
+}
+
+Status ConsumerServer::uploadTooLarge(const std::string& filename, size_t total_size) {
+    LOG_WARN("[CONSUMER] ❌ Refused " << filename << ": " << total_size
+             << " bytes is more than the whole receive memory budget");
+    return Status(grpc::StatusCode::OUT_OF_RANGE,
+                  "Upload is larger than the server's receive memory limit");
+}
+
+Status ConsumerServer::oversizedUpload(const std::string& filename, size_t total_size) {
+    LOG_WARN("[CONSUMER] ❌ Refused " << filename << ": more data than the "
+             << total_size << " bytes announced");
+    return Status(grpc::StatusCode::INVALID_ARGUMENT,
+                  "Upload sent more data than its announced total_size");
+}
+
+uint64_t ConsumerServer::traceIdFor(ServerContext* context) {
+    const auto& metadata = context->client_metadata();
+    auto it = metadata.find(Tracer::METADATA_KEY);
+    if (it != metadata.end()) {
+        return Tracer::parseId(std::string(it->second.data(), it->second.size()));
+    }
+    return tracer_.sample();
+}
+
+Status ConsumerServer::acceptUpload(const std::string& video_id,
+                                    const std::string& filename,
+                                    int producer_id, size_t total_size,
+                                    const std::string& expected_hash,
+                                    uint64_t credit_id,
+                                    uint64_t trace_id,
+                                    std::vector<char> video_data,
+                                    UploadResponse* response) {
+    // An upload that doesn't end up queued hands its credit's slot back
     if (video_data.empty()) {
+        releaseCredit(credit_id);
         response->set_success(false);
         response->set_message("No data received");
+        response->set_result(UploadResponse::NO_DATA);
         return Status::OK;
     }
 
     // Calculate hash for duplicate detection
+    TraceScope hash_span(tracer_, trace_id, video_id, "hash");
     std::string file_hash = calculateHash(video_data);
+    hash_span.end();
+
+    if (!expected_hash.empty() && expected_hash != file_hash) {
+        LOG_WARN("[CONSUMER] ❌ Checksum mismatch: " << filename
+                 << " (expected " << expected_hash.substr(0, 8) << "..., got "
+                 << file_hash.substr(0, 8) << "...)");
+        response->set_success(false);
+        releaseCredit(credit_id);
+        response->set_message("Checksum mismatch");
+        response->set_result(UploadResponse::CHECKSUM_MISMATCH);
+        return Status::OK;
+    }
     
     // Check for duplicates
     {
         std::lock_guard<std::mutex> lock(hash_mutex_);
         if (uploaded_hashes_.find(file_hash) != uploaded_hashes_.end()) {
             total_duplicates_++;
-            std::cout << "[CONSUMER] ⚠️  Duplicate detected: " << filename 
-                      << " (hash: " << file_hash.substr(0, 8) << "...)" << std::endl;
+            LOG_DEBUG("[CONSUMER] ⚠️  Duplicate detected: " << filename
+                      << " (hash: " << file_hash.substr(0, 8) << "...)");
             response->set_success(false);
             response->set_message("Duplicate file detected");
+            response->set_result(UploadResponse::DUPLICATE);
             
             // Log duplicate info
             VideoMetadata duplicate_meta;
@@ -91,10 +285,17 @@ Status ConsumerServer::UploadVideo(ServerContext* context,
             duplicate_meta.filename = filename;
             duplicate_meta.producer_id = producer_id;
             duplicate_meta.file_hash = file_hash;
+            duplicate_meta.file_size = video_data.size();
+            duplicate_meta.consumer_id = 0;
+            duplicate_meta.upload_time = std::chrono::system_clock::now();
             duplicate_meta.is_duplicate = true;
             
-            std::lock_guard<std::mutex> meta_lock(metadata_mutex_);
-            video_metadata_.push_back(duplicate_meta);
+            {
+                std::lock_guard<std::mutex> meta_lock(metadata_mutex_);
+                appendMetadata(std::move(duplicate_meta));
+            }
+            releaseCredit(credit_id);
+            notifyChange();
             
             return Status::OK;
         }
@@ -102,14 +303,18 @@ Status ConsumerServer::UploadVideo(ServerContext* context,
 
     // Check queue capacity (leaky bucket)
     {
+        TraceScope enqueue_span(tracer_, trace_id, video_id, "enqueue");
         std::lock_guard<std::mutex> lock(queue_mutex_);
-        if (upload_queue_.size() >= static_cast<size_t>(max_queue_size_)) {
+        // A credit already holds a slot; anything else needs a free one
+        if (!redeemCredit(credit_id) && freeSlots() <= 0) {
             total_dropped_++;
-            std::cout << "[CONSUMER] ❌ Queue full! Dropping: " << filename 
-                      << " (queue: " << upload_queue_.size() << "/" 
-                      << max_queue_size_ << ")" << std::endl;
+            LOG_WARN("[CONSUMER] ❌ Queue full! Dropping: " << filename
+                     << " (queue: " << upload_queue_.size() << "/"
+                     << max_queue_size_ << ")");
             response->set_success(false);
             response->set_message("Queue full - video dropped");
+            response->set_result(UploadResponse::QUEUE_FULL);
+            notifyChange();
             return Status::OK;
         }
 
@@ -121,19 +326,165 @@ Status ConsumerServer::UploadVideo(ServerContext* context,
         task.data = std::move(video_data);
         task.file_hash = file_hash;
         task.total_size = total_size;
+        task.trace_id = trace_id;
+        task.enqueued_us = trace_id ? Tracer::nowMicros() : 0;
+        // This thread filled the buffer, so its pages are on this node
+        task.numa_node = CpuAffinity::currentNode();
 
-        upload_queue_.push(std::move(task));
+        upload_queue_.push_back(std::move(task));
         total_received_++;
         
-        std::cout << "[CONSUMER] ✓ Queued: " << filename 
-                  << " (queue: " << upload_queue_.size() << "/" 
-                  << max_queue_size_ << ")" << std::endl;
+        LOG_DEBUG("[CONSUMER] ✓ Queued: " << filename
+                  << " (queue: " << upload_queue_.size() << "/"
+                  << max_queue_size_ << ")");
     }
     
-    queue_cv_.notify_one();
+    if (numa_dispatch_) {
+        queue_cv_.notify_all();  // wake a worker of the upload's own node
+    } else {
+        queue_cv_.notify_one();
+    }
+    notifyChange();
 
     response->set_success(true);
     response->set_message("Video queued for processing");
+    response->set_result(UploadResponse::QUEUED);
+    return Status::OK;
+}
+
+int ConsumerServer::freeSlots() const {
+    return max_queue_size_ - static_cast<int>(upload_queue_.size()) - reserved_slots_;
+}
+
+bool ConsumerServer::redeemCredit(uint64_t credit_id) {
+    if (credit_id == 0) {
+        return false;
+    }
+    auto it = credit_subscriptions_.find(credit_id);
+    if (it == credit_subscriptions_.end() || it->second->claimed == 0) {
+        return false;
+    }
+    it->second->claimed--;
+    reserved_slots_--;
+    return true;
+}
+
+void ConsumerServer::releaseCredit(uint64_t credit_id) {
+    if (credit_id == 0) {
+        return;
+    }
+    bool released;
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        released = redeemCredit(credit_id);
+    }
+    if (released) {
+        credit_cv_.notify_all();
+    }
+}
+
+void ConsumerServer::CreditClaim::claim(uint64_t credit_id) {
+    if (credit_id == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(server_.queue_mutex_);
+    auto it = server_.credit_subscriptions_.find(credit_id);
+    // Credits are interchangeable; the oldest is the one nearest to expiring
+    if (it != server_.credit_subscriptions_.end() && !it->second->unclaimed.empty()) {
+        it->second->unclaimed.pop_front();
+        it->second->claimed++;
+        credit_id_ = credit_id;
+    }
+}
+
+int ConsumerServer::expireCredits(CreditSubscription& subscription) {
+    auto cutoff = std::chrono::steady_clock::now() -
+                  std::chrono::seconds(CREDIT_CLAIM_TIMEOUT_SEC);
+    int expired = 0;
+    while (!subscription.unclaimed.empty() && subscription.unclaimed.front() < cutoff) {
+        subscription.unclaimed.pop_front();
+        reserved_slots_--;
+        expired++;
+    }
+    return expired;
+}
+
+Status ConsumerServer::Subscribe(ServerContext* context,
+                                 ServerReaderWriter<CreditGrant, CreditRequest>* stream) {
+    auto subscription = std::make_shared<CreditSubscription>();
+    uint64_t subscription_id;
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        subscription_id = next_subscription_id_++;
+        credit_subscriptions_[subscription_id] = subscription;
+    }
+    LOG_INFO("[CONSUMER] Credit subscription #" << subscription_id
+             << " opened");
+
+    // Requests are read on their own thread so grants can go out while
+    // Read() blocks
+    std::thread reader([this, stream, subscription]() {
+        CreditRequest request;
+        while (stream->Read(&request)) {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            subscription->requested += std::max(0, request.credits());
+            credit_cv_.notify_all();
+        }
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        subscription->closed = true;
+        credit_cv_.notify_all();
+    });
+
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    while (running_ && !draining_ && !subscription->closed && !context->IsCancelled()) {
+        int expired = expireCredits(*subscription);
+        if (expired > 0) {
+            LOG_WARN("[CONSUMER] Credit subscription #" << subscription_id << ": "
+                     << expired << " credit(s) unused for " << CREDIT_CLAIM_TIMEOUT_SEC
+                     << "s, slots released");
+            credit_cv_.notify_all();
+        }
+
+        // Grants go to whichever subscriber wakes first once a slot frees up
+        if (subscription->requested == 0 || freeSlots() <= 0) {
+            credit_cv_.wait_for(lock, std::chrono::seconds(1));
+            continue;
+        }
+
+        int granted = std::min(subscription->requested, freeSlots());
+        subscription->requested -= granted;
+        subscription->unclaimed.insert(subscription->unclaimed.end(), granted,
+                                       std::chrono::steady_clock::now());
+        reserved_slots_ += granted;
+        lock.unlock();
+
+        CreditGrant grant;
+        grant.set_credits(granted);
+        grant.set_subscription_id(subscription_id);
+        bool written = stream->Write(grant);
+
+        lock.lock();
+        if (!written) {
+            break;
+        }
+    }
+
+    // Credits the producer never used go back to everyone else
+    reserved_slots_ -= subscription->outstanding();
+    subscription->unclaimed.clear();
+    subscription->claimed = 0;
+    credit_subscriptions_.erase(subscription_id);
+    bool reader_done = subscription->closed;
+    lock.unlock();
+    credit_cv_.notify_all();
+
+    if (!reader_done) {
+        context->TryCancel();  // unblocks the reader's Read()
+    }
+    reader.join();
+
+    LOG_INFO("[CONSUMER] Credit subscription #" << subscription_id
+             << " closed");
     return Status::OK;
 }
 
@@ -142,10 +493,11 @@ Status ConsumerServer::GetQueueStatus(ServerContext* context,
                                      QueueStatusResponse* response) {
     std::lock_guard<std::mutex> lock(queue_mutex_);
     
+    // Slots reserved by credits are as good as taken
     response->set_current_size(upload_queue_.size());
     response->set_max_size(max_queue_size_);
-    response->set_is_full(upload_queue_.size() >= static_cast<size_t>(max_queue_size_));
-    response->set_available_slots(max_queue_size_ - upload_queue_.size());
+    response->set_is_full(freeSlots() <= 0);
+    response->set_available_slots(std::max(0, freeSlots()));
     
     return Status::OK;
 }
@@ -153,72 +505,84 @@ Status ConsumerServer::GetQueueStatus(ServerContext* context,
 Status ConsumerServer::GetStatistics(ServerContext* context,
                                     const StatisticsRequest* request,
                                     StatisticsResponse* response) {
-    std::lock_guard<std::mutex> lock(metadata_mutex_);
+    ServerStatistics stats = getStatistics();
     
-    response->set_total_received(total_received_);
-    response->set_total_processed(processed_videos_.size());
-    response->set_total_dropped(total_dropped_);
-    response->set_total_duplicates(total_duplicates_);
-    response->set_queue_size(upload_queue_.size());
+    response->set_total_received(stats.total_received);
+    response->set_total_processed(stats.total_processed);
+    response->set_total_dropped(stats.total_dropped);
+    response->set_total_duplicates(stats.total_duplicates);
+    response->set_queue_size(stats.queue_size);
+    response->set_memory_in_use(stats.memory_in_use);
+    response->set_memory_limit(stats.memory_limit);
+    response->set_memory_waits(stats.memory_waits);
+    response->set_memory_blocked_ms(stats.memory_blocked_ms);
     
     return Status::OK;
 }
 
+void ConsumerServer::appendChunk(std::vector<char>& video_data, const std::string& chunk) {
+    video_data.insert(video_data.end(), chunk.begin(), chunk.end());
+}
+
 std::string ConsumerServer::calculateHash(const std::vector<char>& data) {
     unsigned char hash[SHA256_DIGEST_LENGTH];
     SHA256(reinterpret_cast<const unsigned char*>(data.data()), 
            data.size(), hash);
-    
+    return hexEncode(hash, SHA256_DIGEST_LENGTH);
+}
+
+std::string ConsumerServer::hexEncode(const unsigned char* data, size_t length) {
     std::stringstream ss;
-    for (int i = 0; i < SHA256_DIGEST_LENGTH; i++) {
+    for (size_t i = 0; i < length; i++) {
         ss << std::hex << std::setw(2) << std::setfill('0') 
-           << static_cast<int>(hash[i]);
+           << static_cast<int>(data[i]);
     }
     return ss.str();
 }
 
-void ConsumerServer::consumerWorker(int consumer_id) {
-    std::cout << "[CONSUMER-" << consumer_id << "] Worker started" << std::endl;
-
-    while (running_) {
-        std::unique_lock<std::mutex> lock(queue_mutex_);
-        
-        queue_cv_.wait(lock, [this] {
-            return !upload_queue_.empty() || !running_;
-        });
-
-        if (!running_ && upload_queue_.empty()) {
-            break;
+void ConsumerServer::consumerWorker(int consumer_id, int node) {
+#ifdef __linux__
+    // Shows up in top -H, perf and gdb
+    pthread_setname_np(pthread_self(), ("consumer-" + std::to_string(consumer_id)).c_str());
+#endif
+    LOG_INFO("[CONSUMER-" << consumer_id << "] Worker started"
+             << (node >= 0 ? " on node " + std::to_string(node) + ", CPUs " +
+                             CpuAffinity::formatCpuList(CpuAffinity::currentCpus())
+                           : std::string()));
+
+    UploadTask task;
+    while (running_ && popTask(task, node)) {
+        if (task.trace_id) {
+            tracer_.record(task.trace_id, task.video_id, "queue_wait",
+                           task.enqueued_us, Tracer::nowMicros());
         }
 
-        if (upload_queue_.empty()) {
-            continue;
-        }
-
-        UploadTask task = std::move(upload_queue_.front());
-        upload_queue_.pop();
-        lock.unlock();
-
         // Process the video
-        std::cout << "\n[CONSUMER-" << consumer_id << "] Processing: " 
-                  << task.filename << std::endl;
+        LOG_DEBUG("[CONSUMER-" << consumer_id << "] Processing: "
+                  << task.filename);
 
         auto start_time = std::chrono::steady_clock::now();
         
         // Save video file
         std::string output_path = output_dir_ + "/" + task.video_id + "_" + task.filename;
+        TraceScope write_span(tracer_, task.trace_id, task.video_id, "write");
         std::ofstream output_file(output_path, std::ios::binary);
         
         if (output_file) {
             output_file.write(task.data.data(), task.data.size());
             output_file.close();
+            write_span.end();
+            if (!task.spool_path.empty()) {
+                std::error_code ec;
+                fs::remove(task.spool_path, ec);
+            }
             
             auto end_time = std::chrono::steady_clock::now();
             auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
                 end_time - start_time).count();
 
-            std::cout << "[CONSUMER-" << consumer_id << "] ✓ Saved: " 
-                      << output_path << " (" << duration << "ms)" << std::endl;
+            LOG_DEBUG("[CONSUMER-" << consumer_id << "] ✓ Saved: "
+                      << output_path << " (" << duration << "ms)");
 
             // Store metadata
             VideoMetadata meta;
@@ -234,24 +598,112 @@ void ConsumerServer::consumerWorker(int consumer_id) {
 
             {
                 std::lock_guard<std::mutex> meta_lock(metadata_mutex_);
-                video_metadata_.push_back(meta);
+                appendMetadata(meta);
                 processed_videos_[task.video_id] = output_path;
                 uploaded_hashes_.insert(task.file_hash);
             }
+            notifyChange();
 
             // Generate thumbnail (placeholder - would use FFmpeg in real implementation)
+            TraceScope thumbnail_span(tracer_, task.trace_id, task.video_id, "thumbnail");
             generateThumbnail(output_path, task.video_id);
+            thumbnail_span.end();
             
         } else {
-            std::cerr << "[CONSUMER-" << consumer_id << "] ❌ Failed to save: " 
-                      << output_path << std::endl;
+            LOG_ERROR("[CONSUMER-" << consumer_id << "] ❌ Failed to save: "
+                      << output_path);
         }
 
         // Simulate processing time
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        TraceScope process_span(tracer_, task.trace_id, task.video_id, "process");
+        std::this_thread::sleep_for(processing_delay_);
+    }
+
+    LOG_INFO("[CONSUMER-" << consumer_id << "] Worker stopped");
+}
+
+bool ConsumerServer::popTask(UploadTask& task, int node) {
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    bool by_node = numa_dispatch_ && node >= 0;
+    auto next = upload_queue_.end();
+    if (by_node) {
+        idle_workers_[node]++;
+    }
+    queue_cv_.wait(lock, [this, by_node, node, &next] {
+        next = by_node ? findTask(node) : upload_queue_.begin();
+        return next != upload_queue_.end() || !running_;
+    });
+    if (by_node) {
+        idle_workers_[node]--;
+    }
+
+    if (next == upload_queue_.end()) {
+        return false;
+    }
+
+    task = std::move(*next);
+    upload_queue_.erase(next);
+    // One idle worker fewer on this node may free a waiting upload for
+    // the other nodes' workers
+    bool recheck = by_node && !upload_queue_.empty();
+    lock.unlock();
+    if (recheck) {
+        queue_cv_.notify_all();
     }
+    credit_cv_.notify_all();
+    notifyChange();
+    return true;
+}
 
-    std::cout << "[CONSUMER-" << consumer_id << "] Worker stopped" << std::endl;
+std::deque<UploadTask>::iterator ConsumerServer::findTask(int node) {
+    auto fallback = upload_queue_.end();
+    for (auto it = upload_queue_.begin(); it != upload_queue_.end(); ++it) {
+        if (it->numa_node == node) {
+            return it;
+        }
+        bool unclaimed = it->numa_node < 0 ||
+                         it->numa_node >= static_cast<int>(idle_workers_.size()) ||
+                         idle_workers_[it->numa_node] == 0;
+        if (fallback == upload_queue_.end() && unclaimed) {
+            fallback = it;
+        }
+    }
+    return fallback;
+}
+
+// `cpus` narrowed to the node's CPUs; the whole node if that leaves nothing
+static std::vector<int> nodeSubset(int node, const std::vector<int>& cpus) {
+    std::vector<int> node_cpus = CpuAffinity::nodeCpus(node);
+    std::vector<int> subset;
+    for (int cpu : node_cpus) {
+        if (cpus.empty() || std::find(cpus.begin(), cpus.end(), cpu) != cpus.end()) {
+            subset.push_back(cpu);
+        }
+    }
+    return subset.empty() ? node_cpus : subset;
+}
+
+void ConsumerServer::setThreadPlacement(const ThreadPlacement& placement) {
+    placement_ = placement;
+    numa_dispatch_ = placement.numa && CpuAffinity::nodeCount() > 1;
+    idle_workers_.assign(CpuAffinity::nodeCount(), 0);
+}
+
+void ConsumerServer::placeRpcThread() {
+    thread_local bool placed = false;
+    if (placed) {
+        return;
+    }
+    placed = true;
+
+    // With NUMA dispatch RPC threads are dealt out over the nodes, so each
+    // one's uploads stay on one node from receive to save
+    if (numa_dispatch_) {
+        int node = next_rpc_node_++ % CpuAffinity::nodeCount();
+        CpuAffinity::pinCurrentThread(nodeSubset(node, placement_.grpc_cpus));
+    } else if (!placement_.grpc_cpus.empty()) {
+        CpuAffinity::pinCurrentThread(placement_.grpc_cpus);
+    }
 }
 
 void ConsumerServer::generateThumbnail(const std::string& video_path, 
@@ -266,36 +718,195 @@ void ConsumerServer::generateThumbnail(const std::string& video_path,
     }
     
     // For now, just log that we would generate it
-    std::cout << "[THUMBNAIL] Would generate thumbnail for: " << video_id << std::endl;
+    LOG_DEBUG("[THUMBNAIL] Would generate thumbnail for: " << video_id);
 }
 
 void ConsumerServer::start() {
-    // Start consumer worker threads
+    // Uploads accepted before the last restart go first
+    size_t restored = loadSpool();
+    if (restored > 0) {
+        std::cout << "♻️  Restored " << restored << " queued uploads from " << spool_dir_
+                  << std::endl;
+    }
+
+    // Start consumer worker threads; with NUMA dispatch they are dealt
+    // out over the nodes
     for (int i = 0; i < num_consumers_; i++) {
-        consumer_threads_.emplace_back([this, i]() {
-            consumerWorker(i + 1);
+        std::vector<int> cpus = placement_.consumer_cpus;
+        int node = cpus.empty() ? -1 : CpuAffinity::nodeOfCpus(cpus);
+        if (numa_dispatch_) {
+            node = i % CpuAffinity::nodeCount();
+            cpus = nodeSubset(node, placement_.consumer_cpus);
+        }
+        consumer_threads_.emplace_back([this, i, cpus, node]() {
+            if (!cpus.empty()) {
+                CpuAffinity::pinCurrentThread(cpus);
+            }
+            consumerWorker(i + 1, node);
         });
     }
 
     std::cout << "\n✓ Started " << num_consumers_ << " consumer workers" << std::endl;
 }
 
-void ConsumerServer::stop() {
+void ConsumerServer::beginShutdown() {
+    draining_ = true;
+    credit_cv_.notify_all();  // ends the Subscribe streams
+}
+
+void ConsumerServer::stop(std::chrono::steady_clock::time_point drain_deadline) {
+    Logger::instance().flush();
     std::cout << "\nStopping consumer server..." << std::endl;
-    
-    running_ = false;
+    beginShutdown();
+
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex_);
+        if (!upload_queue_.empty() && drain_deadline > std::chrono::steady_clock::now()) {
+            std::cout << "Draining " << upload_queue_.size() << " queued uploads..." << std::endl;
+            // popTask() wakes credit_cv_ after every upload it hands out
+            credit_cv_.wait_until(lock, drain_deadline, [this]() {
+                return upload_queue_.empty();
+            });
+        }
+        running_ = false;
+    }
     queue_cv_.notify_all();
+    credit_cv_.notify_all();
 
+    // Workers finish the upload in hand; the rest stays queued
     for (auto& thread : consumer_threads_) {
         if (thread.joinable()) {
             thread.join();
         }
     }
 
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        size_t spooled = spoolQueue();
+        if (spooled > 0) {
+            std::cout << "💾 Spooled " << spooled << " queued uploads to " << spool_dir_
+                      << " for the next start" << std::endl;
+        }
+    }
+
     printStatistics();
 }
 
+// A spool file is a small text header followed by the upload's bytes:
+//   MEDIASPOOL 1
+//   <video_id>
+//   <filename>
+//   <producer_id> <total_size> <data_size>
+//   <file_hash>
+bool ConsumerServer::writeSpoolFile(const UploadTask& task, const std::string& path) {
+    // Written under a temporary name, so a crash mid-write leaves no
+    // half file to restore
+    std::string temp_path = path + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        out << "MEDIASPOOL 1\n" << task.video_id << "\n" << task.filename << "\n"
+            << task.producer_id << " " << task.total_size << " " << task.data.size() << "\n"
+            << task.file_hash << "\n";
+        out.write(task.data.data(), static_cast<std::streamsize>(task.data.size()));
+        if (!out) {
+            std::error_code ec;
+            fs::remove(temp_path, ec);
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    fs::rename(temp_path, path, ec);
+    return !ec;
+}
+
+bool ConsumerServer::readSpoolFile(const std::string& path, UploadTask& task) {
+    std::ifstream in(path, std::ios::binary);
+    std::string magic, sizes;
+    size_t data_size = 0;
+    if (!std::getline(in, magic) || magic != "MEDIASPOOL 1" ||
+        !std::getline(in, task.video_id) || !std::getline(in, task.filename) ||
+        !std::getline(in, sizes) || !std::getline(in, task.file_hash)) {
+        return false;
+    }
+    std::istringstream fields(sizes);
+    if (!(fields >> task.producer_id >> task.total_size >> data_size)) {
+        return false;
+    }
+
+    task.data.resize(data_size);
+    in.read(task.data.data(), static_cast<std::streamsize>(data_size));
+    if (static_cast<size_t>(in.gcount()) != data_size) {
+        return false;
+    }
+    task.spool_path = path;
+    return true;
+}
+
+size_t ConsumerServer::loadSpool() {
+    std::error_code ec;
+    if (!fs::is_directory(spool_dir_, ec)) {
+        return 0;
+    }
+
+    // Names start with the spool time and queue position, so sorting
+    // them restores the queue order
+    std::vector<std::string> paths;
+    for (const auto& entry : fs::directory_iterator(spool_dir_, ec)) {
+        if (entry.path().extension() == ".upload") {
+            paths.push_back(entry.path().string());
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+
+    size_t restored = 0;
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    for (const auto& path : paths) {
+        UploadTask task;
+        if (!readSpoolFile(path, task)) {
+            LOG_ERROR("[CONSUMER] ❌ Unreadable spool file, skipped: " << path);
+            continue;
+        }
+        upload_queue_.push_back(std::move(task));
+        total_received_++;
+        restored++;
+    }
+    return restored;
+}
+
+size_t ConsumerServer::spoolQueue() {
+    if (upload_queue_.empty()) {
+        return 0;
+    }
+    std::error_code ec;
+    fs::create_directories(spool_dir_, ec);
+
+    int64_t spool_time = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    size_t spooled = 0;
+    for (size_t position = 0; !upload_queue_.empty(); position++) {
+        UploadTask& task = upload_queue_.front();
+        // Restored uploads are still on disk under their old name
+        if (!task.spool_path.empty()) {
+            spooled++;
+        } else {
+            char name[64];
+            snprintf(name, sizeof(name), "%lld_%06zu.upload",
+                     static_cast<long long>(spool_time), position);
+            if (writeSpoolFile(task, (fs::path(spool_dir_) / name).string())) {
+                spooled++;
+            } else {
+                LOG_ERROR("[CONSUMER] ❌ Could not spool " << task.filename
+                          << ", it is lost");
+            }
+        }
+        upload_queue_.pop_front();
+    }
+    return spooled;
+}
+
 void ConsumerServer::printStatistics() {
+    Logger::instance().flush();
     std::cout << "\n=== Final Statistics ===" << std::endl;
     std::cout << "Total received:   " << total_received_ << std::endl;
     std::cout << "Total processed:  " << processed_videos_.size() << std::endl;
@@ -305,9 +916,81 @@ void ConsumerServer::printStatistics() {
               << (total_received_ > 0 ? 
                   (processed_videos_.size() * 100.0 / total_received_) : 0)
               << "%" << std::endl;
+
+    MemoryBudgetStats memory = memory_budget_.stats();
+    std::cout << "Receive buffers:  peak " << memory.peak / (1024 * 1024) << " MB of "
+              << (memory.limit ? std::to_string(memory.limit / (1024 * 1024)) + " MB"
+                               : std::string("unlimited"))
+              << ", " << memory.waits << " uploads waited " << memory.blocked_ms
+              << " ms in total" << std::endl;
 }
 
 std::vector<VideoMetadata> ConsumerServer::getVideoMetadata() {
     std::lock_guard<std::mutex> lock(metadata_mutex_);
     return video_metadata_;
 }
+
+void ConsumerServer::appendMetadata(VideoMetadata meta) {
+    meta.version = ++metadata_version_;
+    video_metadata_.push_back(std::move(meta));
+}
+
+uint64_t ConsumerServer::getMetadataVersion() {
+    std::lock_guard<std::mutex> lock(metadata_mutex_);
+    return metadata_version_;
+}
+
+std::vector<VideoMetadata> ConsumerServer::getVideoMetadataSince(uint64_t since_version,
+                                                                 uint64_t* current_version) {
+    std::lock_guard<std::mutex> lock(metadata_mutex_);
+    if (current_version) {
+        *current_version = metadata_version_;
+    }
+
+    // Entries are appended in version order, so the new ones are a suffix
+    auto first_new = std::upper_bound(
+        video_metadata_.begin(), video_metadata_.end(), since_version,
+        [](uint64_t version, const VideoMetadata& meta) { return version < meta.version; });
+
+    return std::vector<VideoMetadata>(first_new, video_metadata_.end());
+}
+
+ServerStatistics ConsumerServer::getStatistics() {
+    ServerStatistics stats;
+    stats.total_received = total_received_;
+    stats.total_dropped = total_dropped_;
+    stats.total_duplicates = total_duplicates_;
+    stats.max_queue_size = max_queue_size_;
+    {
+        std::lock_guard<std::mutex> lock(metadata_mutex_);
+        stats.total_processed = static_cast<int>(processed_videos_.size());
+    }
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        stats.queue_size = static_cast<int>(upload_queue_.size());
+    }
+    MemoryBudgetStats memory = memory_budget_.stats();
+    stats.memory_in_use = memory.in_use;
+    stats.memory_limit = memory.limit;
+    stats.memory_peak = memory.peak;
+    stats.memory_waiting = memory.waiting;
+    stats.memory_waits = memory.waits;
+    stats.memory_blocked_ms = memory.blocked_ms;
+    return stats;
+}
+
+void ConsumerServer::notifyChange() {
+    {
+        std::lock_guard<std::mutex> lock(change_mutex_);
+        change_seq_++;
+    }
+    change_cv_.notify_all();
+}
+
+uint64_t ConsumerServer::waitForChange(uint64_t seen_seq, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(change_mutex_);
+    change_cv_.wait_for(lock, timeout, [this, seen_seq] {
+        return change_seq_ != seen_seq;
+    });
+    return change_seq_;
+}
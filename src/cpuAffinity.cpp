@@ -0,0 +1,171 @@
+#include "include/cpuAffinity.h"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <filesystem>
+
+#ifdef __linux__
+    #include <pthread.h>
+    #include <sched.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// CPUs of each NUMA node, from /sys/devices/system/node/node<N>/cpulist
+struct NumaLayout {
+    std::vector<std::vector<int>> node_cpus;
+    std::vector<int> cpu_node;  // indexed by CPU number
+
+    NumaLayout() {
+#ifdef __linux__
+        for (int node = 0;; node++) {
+            std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            std::string list;
+            std::vector<int> cpus;
+            if (!in || !std::getline(in, list) || !CpuAffinity::parseCpuList(list, cpus)) {
+                break;
+            }
+            node_cpus.push_back(cpus);
+            for (int cpu : cpus) {
+                if (cpu >= static_cast<int>(cpu_node.size())) {
+                    cpu_node.resize(cpu + 1, 0);
+                }
+                cpu_node[cpu] = node;
+            }
+        }
+#endif
+        if (node_cpus.empty()) {
+            node_cpus.push_back(CpuAffinity::currentCpus());
+        }
+    }
+};
+
+const NumaLayout& layout() {
+    static const NumaLayout instance;
+    return instance;
+}
+
+}
+
+bool CpuAffinity::parseCpuList(const std::string& text, std::vector<int>& cpus) {
+    cpus.clear();
+    std::istringstream ranges(text);
+    std::string range;
+    while (std::getline(ranges, range, ',')) {
+        if (range.empty()) {
+            continue;
+        }
+        size_t dash = range.find('-');
+        int first, last;
+        try {
+            size_t used = 0;
+            first = std::stoi(range, &used);
+            last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            if (dash == std::string::npos && used != range.size()) {
+                return false;
+            }
+        } catch (const std::exception&) {
+            return false;
+        }
+        if (first < 0 || last < first) {
+            return false;
+        }
+        for (int cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return !cpus.empty();
+}
+
+std::string CpuAffinity::formatCpuList(const std::vector<int>& cpus) {
+    std::string text;
+    for (size_t i = 0; i < cpus.size(); i++) {
+        size_t last = i;
+        while (last + 1 < cpus.size() && cpus[last + 1] == cpus[last] + 1) {
+            last++;
+        }
+        text += (text.empty() ? "" : ",") + std::to_string(cpus[i]);
+        if (last > i) {
+            text += "-" + std::to_string(cpus[last]);
+        }
+        i = last;
+    }
+    return text;
+}
+
+bool CpuAffinity::pinCurrentThread(const std::vector<int>& cpus) {
+#ifdef __linux__
+    if (cpus.empty()) {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+std::vector<int> CpuAffinity::currentCpus() {
+    std::vector<int> cpus;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+#endif
+    if (cpus.empty()) {
+        cpus.push_back(0);
+    }
+    return cpus;
+}
+
+int CpuAffinity::nodeCount() {
+    return static_cast<int>(layout().node_cpus.size());
+}
+
+std::vector<int> CpuAffinity::nodeCpus(int node) {
+    const auto& nodes = layout().node_cpus;
+    return node >= 0 && node < static_cast<int>(nodes.size()) ? nodes[node] : std::vector<int>{};
+}
+
+int CpuAffinity::nodeOfCpu(int cpu) {
+    const auto& cpu_node = layout().cpu_node;
+    return cpu >= 0 && cpu < static_cast<int>(cpu_node.size()) ? cpu_node[cpu] : 0;
+}
+
+int CpuAffinity::nodeOfCpus(const std::vector<int>& cpus) {
+    if (cpus.empty()) {
+        return -1;
+    }
+    int node = nodeOfCpu(cpus.front());
+    for (int cpu : cpus) {
+        if (nodeOfCpu(cpu) != node) {
+            return -1;
+        }
+    }
+    return node;
+}
+
+int CpuAffinity::currentNode() {
+#ifdef __linux__
+    int cpu = sched_getcpu();
+    return cpu >= 0 ? nodeOfCpu(cpu) : 0;
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,145 @@
+#include "include/directoryWatcher.h"
+#include <iostream>
+#include <filesystem>
+#include <algorithm>
+
+#ifdef __linux__
+    #include <unistd.h>
+    #include <poll.h>
+    #include <sys/inotify.h>
+#endif
+
+namespace fs = std::filesystem;
+
+DirectoryWatcher::DirectoryWatcher(Callback on_file)
+    : on_file_(std::move(on_file)), running_(false), inotify_fd_(-1) {}
+
+DirectoryWatcher::~DirectoryWatcher() {
+    stop();
+}
+
+bool DirectoryWatcher::start(const std::vector<std::string>& dirs) {
+#ifdef __linux__
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd_ < 0) {
+        std::cerr << "[PRODUCER] inotify unavailable, new files will not be picked up" << std::endl;
+        return false;
+    }
+
+    for (size_t i = 0; i < dirs.size(); i++) {
+        int wd = inotify_add_watch(inotify_fd_, dirs[i].c_str(), IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO);
+        if (wd < 0) {
+            std::cerr << "[PRODUCER-" << (i + 1) << "] Cannot watch " << dirs[i] << std::endl;
+            continue;
+        }
+        watches_[wd] = {static_cast<int>(i), dirs[i]};
+    }
+    if (watches_.empty()) {
+        return false;
+    }
+
+    running_ = true;
+    watch_thread_ = std::thread([this]() { watchLoop(); });
+    return true;
+#else
+    (void)dirs;
+    std::cerr << "[PRODUCER] Watching directories needs inotify (Linux only)" << std::endl;
+    return false;
+#endif
+}
+
+void DirectoryWatcher::stop() {
+    running_ = false;
+    if (watch_thread_.joinable()) {
+        watch_thread_.join();
+    }
+#ifdef __linux__
+    if (inotify_fd_ >= 0) {
+        close(inotify_fd_);
+        inotify_fd_ = -1;
+    }
+#endif
+}
+
+void DirectoryWatcher::watchLoop() {
+#ifdef __linux__
+    alignas(inotify_event) char events[4096];
+    while (running_) {
+        pollfd pfd{inotify_fd_, POLLIN, 0};
+        if (poll(&pfd, 1, pollTimeout()) <= 0) {
+            reportSettled();
+            continue;
+        }
+
+        ssize_t length;
+        while ((length = read(inotify_fd_, events, sizeof(events))) > 0) {
+            auto due = std::chrono::steady_clock::now() + std::chrono::milliseconds(SETTLE_MS);
+            for (char* p = events; p < events + length; ) {
+                auto* event = reinterpret_cast<inotify_event*>(p);
+                p += sizeof(inotify_event) + event->len;
+
+                if (event->mask & IN_Q_OVERFLOW) {
+                    std::cerr << "[PRODUCER] Directory events were lost, rescanning" << std::endl;
+                    rescan();
+                    continue;
+                }
+
+                auto it = watches_.find(event->wd);
+                if (it == watches_.end() || event->len == 0 || (event->mask & IN_ISDIR)) {
+                    continue;
+                }
+                std::string path = (fs::path(it->second.second) / event->name).string();
+
+                if (event->mask & IN_MOVED_TO) {
+                    // A rename lands the whole file at once
+                    settling_.erase(path);
+                    on_file_(it->second.first, path);
+                } else if (event->mask & IN_CLOSE_WRITE) {
+                    settling_[path] = {it->second.first, due};
+                } else if (event->mask & IN_MODIFY) {
+                    // Reopened and written to again: wait for the next close
+                    auto settling = settling_.find(path);
+                    if (settling != settling_.end()) {
+                        settling->second.due = due;
+                    }
+                }
+            }
+        }
+        reportSettled();
+    }
+#endif
+}
+
+void DirectoryWatcher::rescan() {
+    auto due = std::chrono::steady_clock::now() + std::chrono::milliseconds(SETTLE_MS);
+    for (const auto& [wd, watch] : watches_) {
+        std::error_code ec;
+        for (fs::directory_iterator it(watch.second, ec), end; !ec && it != end; it.increment(ec)) {
+            if (it->is_regular_file(ec)) {
+                settling_[it->path().string()] = {watch.first, due};
+            }
+        }
+    }
+}
+
+void DirectoryWatcher::reportSettled() {
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = settling_.begin(); it != settling_.end(); ) {
+        if (it->second.due <= now) {
+            on_file_(it->second.index, it->first);
+            it = settling_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+int DirectoryWatcher::pollTimeout() const {
+    int timeout = POLL_INTERVAL_MS;
+    auto now = std::chrono::steady_clock::now();
+    for (const auto& [path, settling] : settling_) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(settling.due - now).count();
+        timeout = std::min<int>(timeout, std::max<int64_t>(left + 1, 0));
+    }
+    return timeout;
+}
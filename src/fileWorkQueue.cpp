@@ -0,0 +1,336 @@
+#include "include/fileWorkQueue.h"
+#include <iostream>
+#include <filesystem>
+#include <algorithm>
+#include <chrono>
+
+namespace fs = std::filesystem;
+
+FileWorkQueue::FileWorkQueue(Mode mode, int num_producers)
+    : mode_(mode),
+      queues_(mode == Mode::Shared ? 1 : num_producers),
+      queued_bytes_(queues_.size(), 0),
+      in_flight_(0), continuous_(false), stopping_(false),
+      total_files_(0), total_bytes_(0) {}
+
+bool FileWorkQueue::isVideoFile(const std::string& filename) {
+    std::string lower = filename;
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    
+    const std::vector<std::string> extensions = {
+        ".mp4", ".avi", ".mov", ".mkv", ".flv", ".wmv", ".webm", ".m4v"
+    };
+    
+    for (const auto& ext : extensions) {
+        if (lower.size() >= ext.size() &&
+            lower.substr(lower.size() - ext.size()) == ext) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string FileWorkQueue::absolutePath(const std::string& path) {
+    std::error_code ec;
+    fs::path absolute = fs::absolute(path, ec);
+    return ec ? path : absolute.lexically_normal().string();
+}
+
+bool FileWorkQueue::parseMode(const std::string& name, Mode& mode) {
+    if (name == "dir") {
+        mode = Mode::PerDirectory;
+    } else if (name == "steal") {
+        mode = Mode::WorkStealing;
+    } else if (name == "shared") {
+        mode = Mode::Shared;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* FileWorkQueue::modeName(Mode mode) {
+    switch (mode) {
+        case Mode::PerDirectory: return "per-directory";
+        case Mode::WorkStealing: return "per-directory with work stealing";
+        case Mode::Shared: return "shared, largest first";
+    }
+    return "";
+}
+
+std::deque<FileTask>& FileWorkQueue::queueFor(int index) {
+    return queues_[mode_ == Mode::Shared ? 0 : index];
+}
+
+void FileWorkQueue::sortLargestFirst(std::deque<FileTask>& queue) {
+    std::stable_sort(queue.begin(), queue.end(),
+                     [](const FileTask& a, const FileTask& b) { return a.size > b.size; });
+}
+
+size_t FileWorkQueue::addDirectory(int owner, const std::string& dir) {
+    if (!fs::exists(dir)) {
+        std::cerr << "[PRODUCER-" << (owner + 1) << "] Directory not found: " 
+                  << dir << std::endl;
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& queue = queueFor(owner);
+    size_t found = 0;
+    size_t skipped = 0;
+
+    for (const auto& entry : fs::directory_iterator(dir)) {
+        if (entry.is_regular_file() && isVideoFile(entry.path().filename().string())) {
+            std::error_code ec;
+            uint64_t size = entry.file_size(ec);
+            if (ec) {
+                size = 0;
+            }
+            int64_t mtime = entry.last_write_time(ec).time_since_epoch().count();
+            if (enqueue(queue, {entry.path().string(), size, owner}, mtime)) {
+                found++;
+            } else {
+                skipped++;
+            }
+        }
+    }
+
+    if (mode_ != Mode::PerDirectory) {
+        sortLargestFirst(queue);
+    }
+    cv_.notify_all();
+
+    std::cout << "[PRODUCER-" << (owner + 1) << "] Found " << found 
+              << " video files in " << dir;
+    if (skipped > 0) {
+        std::cout << " (" << skipped << " already uploaded or waiting for a retry)";
+    }
+    std::cout << std::endl;
+    return found;
+}
+
+bool FileWorkQueue::addFile(int owner, const std::string& path) {
+    std::error_code ec;
+    if (!isVideoFile(fs::path(path).filename().string()) || !fs::is_regular_file(path, ec)) {
+        return false;
+    }
+    uint64_t size = fs::file_size(path, ec);
+    if (ec) {
+        return false;
+    }
+    int64_t mtime = fs::last_write_time(path, ec).time_since_epoch().count();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& queue = queueFor(owner);
+    if (!enqueue(queue, {path, size, owner}, mtime)) {
+        // A retry reads the file again anyway; anything else claimed may
+        // have been read before this write
+        std::string absolute = absolutePath(path);
+        if (ledger_ && retry_paths_.count(absolute) == 0 && ledger_->isClaimed(absolute)) {
+            changed_[absolute] = owner;
+        }
+        return false;
+    }
+    if (mode_ != Mode::PerDirectory) {
+        // Move the new file from the back to its place in size order
+        auto position = std::upper_bound(queue.begin(), queue.end() - 1, size,
+            [](uint64_t new_size, const FileTask& queued) { return new_size > queued.size; });
+        std::rotate(position, queue.end() - 1, queue.end());
+    }
+    cv_.notify_all();
+    return true;
+}
+
+bool FileWorkQueue::enqueue(std::deque<FileTask>& queue, FileTask task, int64_t mtime) {
+    // Absolute paths keep the ledger and journal valid whatever the
+    // working directory of the next run
+    task.path = absolutePath(task.path);
+    if (retry_paths_.count(task.path) > 0) {
+        return false;
+    }
+    if (ledger_ && !ledger_->claim(task.path, task.size, mtime)) {
+        return false;
+    }
+    queued_bytes_[&queue - queues_.data()] += task.size;
+    total_bytes_ += task.size;
+    total_files_++;
+    queue.push_back(std::move(task));
+    return true;
+}
+
+size_t FileWorkQueue::replayJournal() {
+    if (!journal_) {
+        return 0;
+    }
+
+    size_t replayed = 0;
+    auto now = std::chrono::steady_clock::now();
+    int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    for (const auto& entry : journal_->pending()) {
+        std::error_code ec;
+        uint64_t size = fs::file_size(entry.path, ec);
+        if (ec) {
+            std::cerr << "[PRODUCER] Dropping retry of " << entry.path 
+                      << ": file no longer exists" << std::endl;
+            journal_->remove(entry.path);
+            continue;
+        }
+        int64_t mtime = fs::last_write_time(entry.path, ec).time_since_epoch().count();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (ledger_ && !ledger_->claim(entry.path, size, mtime)) {
+            journal_->remove(entry.path);  // delivered after all
+            continue;
+        }
+        auto delay = std::chrono::milliseconds(std::max<int64_t>(0, entry.due_ms - now_ms));
+        retries_.push({{entry.path, size, entry.owner}, now + delay});
+        retry_paths_.insert(entry.path);
+        replayed++;
+    }
+
+    cv_.notify_all();
+    return replayed;
+}
+
+bool FileWorkQueue::next(int index, FileTask& task) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!takeNext(index, task)) {
+        // Uploads still in flight may fail and come back as retries
+        if (stopping_ || (!continuous_ && retries_.empty() && in_flight_ == 0)) {
+            return false;
+        }
+        // New files, completions and stop() all notify; only a retry
+        // coming due needs a timeout
+        if (retries_.empty()) {
+            cv_.wait(lock);
+        } else {
+            cv_.wait_until(lock, retries_.top().due);
+        }
+    }
+    return true;
+}
+
+bool FileWorkQueue::tryNext(int index, FileTask& task) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return takeNext(index, task);
+}
+
+bool FileWorkQueue::complete(const FileTask& task, UploadOutcome outcome,
+                             int& attempt, std::chrono::milliseconds& delay) {
+    bool retry = false;
+    if (journal_) {
+        if (outcome == UploadOutcome::Delivered || outcome == UploadOutcome::Permanent) {
+            journal_->remove(task.path);
+        } else {
+            retry = journal_->schedule(task.path, task.owner, outcome, attempt, delay);
+        }
+    }
+
+    // A file waiting for a retry stays claimed, so the watcher cannot
+    // queue it a second time
+    if (ledger_) {
+        if (outcome == UploadOutcome::Delivered) {
+            ledger_->commit(task.path);
+        } else if (!retry) {
+            ledger_->release(task.path);
+        }
+    }
+
+    int changed_owner = -1;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        in_flight_--;
+        if (retry && !stopping_) {
+            retries_.push({task, std::chrono::steady_clock::now() + delay});
+            retry_paths_.insert(task.path);
+        }
+        auto changed = changed_.find(task.path);
+        if (changed != changed_.end()) {
+            if (!retry) {
+                changed_owner = changed->second;
+            }
+            changed_.erase(changed);
+        }
+    }
+    cv_.notify_all();
+
+    // The ledger has this upload now, so a version written since is
+    // claimed afresh; an unchanged file is skipped as usual
+    if (changed_owner >= 0 && !stopping_) {
+        addFile(changed_owner, task.path);
+    }
+    return retry;
+}
+
+void FileWorkQueue::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        continuous_ = false;
+    }
+    cv_.notify_all();
+}
+
+size_t FileWorkQueue::pendingRetries() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return retries_.size();
+}
+
+bool FileWorkQueue::takeNext(int index, FileTask& task) {
+    if (stopping_) {
+        return false;
+    }
+
+    // Due retries go first; ones not due yet don't hold anything up
+    if (!retries_.empty() && retries_.top().due <= std::chrono::steady_clock::now()) {
+        task = retries_.top().task;
+        retries_.pop();
+        retry_paths_.erase(task.path);
+        in_flight_++;
+        return true;
+    }
+
+    size_t source = mode_ == Mode::Shared ? 0 : index;
+    if (queues_[source].empty()) {
+        if (mode_ != Mode::WorkStealing) {
+            return false;
+        }
+
+        // Steal from whoever has the most bytes left to send
+        bool found = false;
+        for (size_t i = 0; i < queues_.size(); i++) {
+            if (!queues_[i].empty() &&
+                (!found || queued_bytes_[i] > queued_bytes_[source])) {
+                source = i;
+                found = true;
+            }
+        }
+        if (!found) {
+            return false;
+        }
+    }
+
+    task = std::move(queues_[source].front());
+    queues_[source].pop_front();
+    queued_bytes_[source] -= task.size;
+    in_flight_++;
+    return true;
+}
+
+bool FileWorkQueue::hasWork(int index) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!retries_.empty()) {
+        return true;
+    }
+    if (mode_ != Mode::WorkStealing) {
+        return !queueFor(index).empty();
+    }
+    for (const auto& queue : queues_) {
+        if (!queue.empty()) {
+            return true;
+        }
+    }
+    return false;
+}
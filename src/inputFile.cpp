@@ -0,0 +1,114 @@
+#include "include/inputFile.h"
+#include <algorithm>
+#include <cstdint>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <cerrno>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/stat.h>
+#endif
+
+InputFile::~InputFile() {
+    close();
+}
+
+bool InputFile::open(const std::string& path) {
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size)) {
+        CloseHandle(file);
+        return false;
+    }
+    handle_ = file;
+    size_ = static_cast<size_t>(file_size.QuadPart);
+    return true;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+    fd_ = fd;
+    size_ = static_cast<size_t>(st.st_size);
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    return true;
+#endif
+}
+
+void InputFile::close() {
+#ifdef _WIN32
+    if (handle_) {
+        CloseHandle(handle_);
+        handle_ = nullptr;
+    }
+#else
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+#endif
+    size_ = 0;
+}
+
+bool InputFile::read(size_t offset, size_t length, char* out) const {
+    while (length > 0) {
+#ifdef _WIN32
+        if (!handle_) {
+            return false;
+        }
+        // An explicit offset leaves the shared file pointer out of it
+        OVERLAPPED at = {};
+        at.Offset = static_cast<DWORD>(offset);
+        at.OffsetHigh = static_cast<DWORD>(static_cast<uint64_t>(offset) >> 32);
+        DWORD step = static_cast<DWORD>(std::min<size_t>(length, 1u << 30));
+        DWORD got = 0;
+        if (!ReadFile(handle_, out, step, &got, &at) || got == 0) {
+            return false;
+        }
+#else
+        ssize_t got = pread(fd_, out, length, static_cast<off_t>(offset));
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;  // error, or the file now ends before this range
+        }
+#endif
+        offset += static_cast<size_t>(got);
+        out += got;
+        length -= static_cast<size_t>(got);
+    }
+    return true;
+}
+
+void InputFile::willNeed(size_t offset, size_t length) const {
+#if !defined(_WIN32) && defined(POSIX_FADV_WILLNEED)
+    if (fd_ < 0 || offset >= size_) {
+        return;
+    }
+    length = std::min(length, size_ - offset);
+    posix_fadvise(fd_, static_cast<off_t>(offset), static_cast<off_t>(length), POSIX_FADV_WILLNEED);
+#else
+    (void)offset;
+    (void)length;
+#endif
+}
@@ -0,0 +1,180 @@
+#include "include/logger.h"
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <cstdlib>
+
+#ifdef __linux__
+    #include <pthread.h>
+#endif
+
+std::atomic<LogLevel> Logger::level_{LogLevel::Info};
+std::atomic<int> Logger::rate_limit_{Logger::DEFAULT_RATE_LIMIT};
+
+// Marks the thread's ring closed when the thread exits, so the writer
+// can free it once it is empty
+struct RingHandle {
+    Logger::Ring* ring = nullptr;
+    ~RingHandle() {
+        if (ring) {
+            ring->closed.store(true, std::memory_order_release);
+            ring = nullptr;
+        }
+    }
+};
+
+static thread_local RingHandle local_ring;
+
+Logger& Logger::instance() {
+    // Never destroyed: threads that outlive main() may still log
+    static Logger* logger = new Logger();
+    return *logger;
+}
+
+Logger::Logger() : next_seq_(0) {
+    std::thread([this]() { run(); }).detach();
+    std::atexit([]() { Logger::instance().flush(); });
+}
+
+bool Logger::parseLevel(const std::string& name, LogLevel& level) {
+    for (LogLevel candidate : {LogLevel::Debug, LogLevel::Info, LogLevel::Warn,
+                               LogLevel::Error, LogLevel::Off}) {
+        if (name == levelName(candidate)) {
+            level = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* Logger::levelName(LogLevel level) {
+    switch (level) {
+        case LogLevel::Debug: return "debug";
+        case LogLevel::Info:  return "info";
+        case LogLevel::Warn:  return "warn";
+        case LogLevel::Error: return "error";
+        case LogLevel::Off:   return "off";
+    }
+    return "info";
+}
+
+bool Logger::admit(Site& site, int& suppressed) {
+    int limit = rate_limit_.load(std::memory_order_relaxed);
+    if (limit <= 0) {
+        return true;
+    }
+
+    int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t second = site.second.load(std::memory_order_relaxed);
+    if (second != now && site.second.compare_exchange_strong(second, now)) {
+        site.count.store(0, std::memory_order_relaxed);
+    }
+
+    if (site.count.fetch_add(1, std::memory_order_relaxed) < limit) {
+        suppressed = site.suppressed.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+    site.suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+Logger::Ring* Logger::localRing() {
+    if (!local_ring.ring) {
+        auto ring = std::make_unique<Ring>();
+        local_ring.ring = ring.get();
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        rings_.push_back(std::move(ring));
+    }
+    return local_ring.ring;
+}
+
+void Logger::write(LogLevel level, std::string message, int suppressed) {
+    if (suppressed > 0) {
+        message += " (" + std::to_string(suppressed) + " similar messages suppressed)";
+    }
+
+    Ring* ring = localRing();
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) >= RING_SIZE) {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Entry& entry = ring->entries[head % RING_SIZE];
+    entry.seq = next_seq_.fetch_add(1, std::memory_order_relaxed);
+    entry.level = level;
+    entry.text = std::move(message);
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+void Logger::flush() {
+    std::lock_guard<std::mutex> lock(drain_mutex_);
+    drain();
+}
+
+void Logger::run() {
+#ifdef __linux__
+    // Started by whichever thread logs first; don't inherit its name
+    pthread_setname_np(pthread_self(), "logger");
+#endif
+    while (true) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(WRITE_INTERVAL_MS));
+        std::lock_guard<std::mutex> lock(drain_mutex_);
+        drain();
+    }
+}
+
+void Logger::drain() {
+    uint64_t dropped = 0;
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        for (auto it = rings_.begin(); it != rings_.end();) {
+            Ring& ring = **it;
+            // Read closed first: a closed ring gets no entries after it
+            bool closed = ring.closed.load(std::memory_order_acquire);
+            uint64_t head = ring.head.load(std::memory_order_acquire);
+            uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+            for (; tail < head; tail++) {
+                batch_.push_back(std::move(ring.entries[tail % RING_SIZE]));
+            }
+            ring.tail.store(tail, std::memory_order_release);
+            dropped += ring.dropped.exchange(0, std::memory_order_relaxed);
+
+            if (closed) {
+                it = rings_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    if (batch_.empty() && dropped == 0) {
+        return;
+    }
+
+    // Rings are drained one after another; the sequence numbers put
+    // messages from different threads back in the order they were logged
+    std::sort(batch_.begin(), batch_.end(), [](const Entry& a, const Entry& b) {
+        return a.seq < b.seq;
+    });
+    for (const auto& entry : batch_) {
+        std::string& out = entry.level >= LogLevel::Warn ? err_ : out_;
+        out += entry.text;
+        out += '\n';
+    }
+    if (dropped > 0) {
+        err_ += "[LOG] " + std::to_string(dropped) + " messages dropped, log buffer full\n";
+    }
+    batch_.clear();
+
+    if (!out_.empty()) {
+        std::cout.write(out_.data(), static_cast<std::streamsize>(out_.size()));
+        std::cout.flush();
+        out_.clear();
+    }
+    if (!err_.empty()) {
+        std::cerr.write(err_.data(), static_cast<std::streamsize>(err_.size()));
+        err_.clear();
+    }
+}
@@ -0,0 +1,359 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <grpcpp/grpcpp.h>
+#include "include/consumerServer.h"
+#include "include/producerClient.h"
+#include "include/channelPool.h"
+#include "include/commandLine.h"
+#include "include/logger.h"
+
+#ifndef _WIN32
+    #include <sys/resource.h>
+#endif
+
+// Runs consumer_server and producer_client in one process: the server
+// gets no listening port, and the producers talk to it over in-process
+// channels, so there is no TCP stack, no second process and (with files
+// on tmpfs) no disk in the way. What is left is the upload path itself,
+// which makes this the binary to point perf at.
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+struct HarnessOptions {
+    int producers = 4;
+    int files_per_producer = 4;
+    size_t file_size = 16 * 1024 * 1024;
+    std::string input_dir;       // empty = generate files
+    std::string output_dir;      // empty = scratch directory
+    int consumers = 4;
+    int queue_size = 64;
+    int rounds = 1;
+    std::chrono::milliseconds processing_delay{0};
+    ProducerOptions producer;
+    bool verbose = false;
+    bool keep_output = false;
+};
+
+// /dev/shm when there is one, so neither side of the run touches a disk
+static fs::path scratchRoot() {
+    std::error_code ec;
+    if (fs::is_directory("/dev/shm", ec)) {
+        return "/dev/shm";
+    }
+    return fs::temp_directory_path();
+}
+
+// Writes <files> random files into producer_N/ for every producer. The
+// round goes into the seed, so every round uploads new content rather
+// than a batch of duplicates.
+static uint64_t generateFiles(const fs::path& dir, const HarnessOptions& options, int round) {
+    fs::remove_all(dir);
+    uint64_t total = 0;
+    std::vector<char> buffer(1024 * 1024);
+    for (int p = 1; p <= options.producers; p++) {
+        fs::path producer_dir = dir / ("producer_" + std::to_string(p));
+        fs::create_directories(producer_dir);
+        for (int f = 1; f <= options.files_per_producer; f++) {
+            std::mt19937_64 rng((static_cast<uint64_t>(round) << 40) |
+                                (static_cast<uint64_t>(p) << 20) | static_cast<uint64_t>(f));
+            std::ofstream out(producer_dir / ("loopback_" + std::to_string(f) + ".mp4"),
+                              std::ios::binary);
+            for (size_t written = 0; written < options.file_size; written += buffer.size()) {
+                for (size_t i = 0; i < buffer.size(); i += sizeof(uint64_t)) {
+                    uint64_t word = rng();
+                    std::memcpy(&buffer[i], &word, sizeof(word));
+                }
+                size_t length = std::min(buffer.size(), options.file_size - written);
+                out.write(buffer.data(), static_cast<std::streamsize>(length));
+            }
+            total += options.file_size;
+        }
+    }
+    return total;
+}
+
+static uint64_t inputBytes(const fs::path& dir, int producers) {
+    uint64_t total = 0;
+    std::error_code ec;
+    for (int p = 1; p <= producers; p++) {
+        fs::path producer_dir = dir / ("producer_" + std::to_string(p));
+        if (!fs::is_directory(producer_dir, ec)) {
+            continue;
+        }
+        for (const auto& entry : fs::directory_iterator(producer_dir, ec)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".mp4") {
+                total += entry.file_size();
+            }
+        }
+    }
+    return total;
+}
+
+// User and system CPU time of the whole process, in seconds
+static void processCpu(double& user, double& system) {
+    user = system = 0;
+#ifndef _WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        user = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+        system = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    }
+#endif
+}
+
+void printUsage(const char* program_name) {
+    std::cout << "Usage: " << program_name << " [-p <producers>] [-g <files>:<size> | -i <input_dir>]"
+              << " [-o <output_dir>] [-c <consumers>] [-q <queue_size>] [-k <channels>]"
+              << " [-m <mode>] [-b <min>[:<max>]] [-w <ms>] [-r <rounds>] [-v] [-s]\n";
+    std::cout << "\nOptions:\n";
+    std::cout << "  -p <producers>      Producer threads (default: 4)\n";
+    std::cout << "  -g <files>:<size>   Generate <files> files of <size> per producer (default: 4:16M)\n";
+    std::cout << "  -i <input_dir>      Upload producer_N/ folders from here instead\n";
+    std::cout << "  -o <output_dir>     Where the server writes uploads (default: scratch space)\n";
+    std::cout << "  -c <consumers>      Consumer threads (default: 4)\n";
+    std::cout << "  -q <queue_size>     Server queue size (default: 64)\n";
+    std::cout << "  -k <channels>       In-process channels (default: 1)\n";
+    std::cout << "  -m <mode>           File queue: dir, steal or shared (default: dir)\n";
+    std::cout << "  -b <min>[:<max>]    Chunk size bounds, one value for fixed chunks (default: 16K:1M)\n";
+    std::cout << "  -w <ms>             Simulated processing time per video (default: 0)\n";
+    std::cout << "  -r <rounds>         Upload the batch this many times, with new content\n";
+    std::cout << "                      each round unless -i is given (default: 1)\n";
+    std::cout << "  -v                  Show the server and producer logs, down to debug level\n";
+    std::cout << "  -s                  Keep generated and uploaded files\n";
+    std::cout << "\nScratch space is /dev/shm when present, so no disk I/O is measured.\n";
+    std::cout << "\nProfiling:\n";
+    std::cout << "  perf record --call-graph fp " << program_name << " -r 20\n";
+    std::cout << "  perf report --sort comm,dso,sym\n";
+    std::cout << "  perf script | stackcollapse-perf.pl | flamegraph.pl > upload.svg\n";
+    std::cout << "Threads are named consumer-N, producer-N and readahead for perf and top -H.\n";
+}
+
+int main(int argc, char** argv) {
+    HarnessOptions options;
+    options.producer.pause_between_files = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        try {
+            if (arg == "-p" && i + 1 < argc) {
+                options.producers = std::stoi(argv[++i]);
+            } else if (arg == "-g" && i + 1 < argc) {
+                std::string spec = argv[++i];
+                size_t colon = spec.find(':');
+                uint64_t file_size = 0;
+                if (colon == std::string::npos ||
+                    !parseQuantity(spec.substr(colon + 1), 1024, file_size) || file_size < 1) {
+                    std::cerr << "Error: -g expects <files>:<size>, e.g. 4:16M" << std::endl;
+                    return 1;
+                }
+                options.file_size = static_cast<size_t>(file_size);
+                options.files_per_producer = std::stoi(spec.substr(0, colon));
+            } else if (arg == "-i" && i + 1 < argc) {
+                options.input_dir = argv[++i];
+            } else if (arg == "-o" && i + 1 < argc) {
+                options.output_dir = argv[++i];
+            } else if (arg == "-c" && i + 1 < argc) {
+                options.consumers = std::stoi(argv[++i]);
+            } else if (arg == "-q" && i + 1 < argc) {
+                options.queue_size = std::stoi(argv[++i]);
+            } else if (arg == "-k" && i + 1 < argc) {
+                options.producer.channels = std::stoi(argv[++i]);
+            } else if (arg == "-m" && i + 1 < argc) {
+                if (!FileWorkQueue::parseMode(argv[++i], options.producer.queue_mode)) {
+                    std::cerr << "Error: Unknown file queue mode: " << argv[i]
+                              << " (expected dir, steal or shared)" << std::endl;
+                    return 1;
+                }
+            } else if (arg == "-b" && i + 1 < argc) {
+                std::string bounds = argv[++i];
+                size_t colon = bounds.find(':');
+                uint64_t min_size = 0;
+                uint64_t max_size = 0;
+                if (!parseQuantity(bounds.substr(0, colon), 1024, min_size) ||
+                    !parseQuantity(colon == std::string::npos ? bounds.substr(0, colon)
+                                                              : bounds.substr(colon + 1),
+                                   1024, max_size) ||
+                    min_size < 1 || max_size < 1) {
+                    std::cerr << "Error: Invalid chunk sizes: " << bounds << std::endl;
+                    return 1;
+                }
+                options.producer.min_chunk_size = static_cast<size_t>(min_size);
+                options.producer.max_chunk_size = static_cast<size_t>(max_size);
+            } else if (arg == "-w" && i + 1 < argc) {
+                options.processing_delay = std::chrono::milliseconds(std::stoi(argv[++i]));
+            } else if (arg == "-r" && i + 1 < argc) {
+                options.rounds = std::stoi(argv[++i]);
+            } else if (arg == "-v") {
+                options.verbose = true;
+            } else if (arg == "-s") {
+                options.keep_output = true;
+            } else if (arg == "-h" || arg == "--help") {
+                printUsage(argv[0]);
+                return 0;
+            } else {
+                std::cerr << "Unknown argument: " << arg << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+        } catch (const std::exception&) {
+            std::cerr << "Error: Invalid value for " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    const auto& producer = options.producer;
+    if (options.producers < 1 || options.consumers < 1 || options.queue_size < 1 ||
+        producer.channels < 1 || options.rounds < 1 || options.files_per_producer < 1) {
+        std::cerr << "Error: Counts must be positive" << std::endl;
+        return 1;
+    }
+    if (producer.min_chunk_size < 1024 || producer.max_chunk_size > ProducerThread::MAX_CHUNK_SIZE ||
+        producer.min_chunk_size > producer.max_chunk_size) {
+        std::cerr << "Error: Chunk sizes must be between 1K and 8M" << std::endl;
+        return 1;
+    }
+
+    fs::path scratch = scratchRoot() / ("upload_loopback_" + std::to_string(
+        std::chrono::system_clock::now().time_since_epoch().count()));
+    fs::path input_dir = options.input_dir.empty() ? scratch / "input" : fs::path(options.input_dir);
+    fs::path output_dir = options.output_dir.empty() ? scratch / "output" : fs::path(options.output_dir);
+    fs::create_directories(output_dir);
+
+    std::cerr << "Input:  " << (options.input_dir.empty() ? "generated in " : "") << input_dir.string() << "\n"
+              << "Output: " << output_dir.string() << "\n";
+
+    // Only the summary is wanted here, and warnings; -v shows everything
+    Logger::setLevel(options.verbose ? LogLevel::Debug : LogLevel::Warn);
+    std::streambuf* console = std::cout.rdbuf();
+    if (!options.verbose) {
+        std::cout.rdbuf(nullptr);
+    }
+
+    auto server = std::make_unique<ConsumerServer>(options.consumers, options.queue_size,
+                                                   output_dir.string());
+    server->setProcessingDelay(options.processing_delay);
+    server->start();
+
+    ServerBuilder builder;
+    builder.SetMaxReceiveMessageSize(ConsumerServer::MAX_MESSAGE_SIZE);
+    builder.RegisterService(server.get());
+    std::unique_ptr<Server> grpc_server = builder.BuildAndStart();
+    if (!grpc_server) {
+        std::cout.rdbuf(console);
+        std::cerr << "Error: Could not start the in-process server" << std::endl;
+        return 1;
+    }
+
+    grpc::ChannelArguments args;
+    args.SetMaxSendMessageSize(ConsumerServer::MAX_MESSAGE_SIZE);
+    args.SetMaxReceiveMessageSize(ConsumerServer::MAX_MESSAGE_SIZE);
+
+    double upload_seconds = 0;
+    uint64_t uploaded_bytes = 0;
+    double cpu_user = 0;
+    double cpu_system = 0;
+    for (int round = 1; round <= options.rounds; round++) {
+        // Generating input is not part of the measurement
+        uint64_t round_bytes = options.input_dir.empty()
+            ? generateFiles(input_dir, options, round)
+            : inputBytes(input_dir, options.producers);
+
+        std::vector<std::shared_ptr<grpc::Channel>> channels;
+        for (int c = 0; c < producer.channels; c++) {
+            channels.push_back(grpc_server->InProcessChannel(args));
+        }
+        auto pool = std::make_shared<ChannelPool>(channels);
+
+        double user_before, system_before;
+        processCpu(user_before, system_before);
+        auto round_start = Clock::now();
+
+        ProducerClient client(options.producers, input_dir.string(), pool, producer);
+        client.start();
+
+        // Uploads count once the consumers have written them out. The
+        // producers are done, so that is when everything the server
+        // accepted has been processed, not merely taken off the queue;
+        // dropped and duplicate uploads never reach a consumer. The
+        // server's change notifications wake this, so the run being
+        // profiled isn't polled for its locks.
+        uint64_t seen_seq = server->waitForChange(0, std::chrono::milliseconds(0));
+        auto last_change = Clock::now();
+        while (true) {
+            ServerStatistics stats = server->getStatistics();
+            if (stats.total_processed >= stats.total_received) {
+                break;
+            }
+            uint64_t seq = server->waitForChange(seen_seq, std::chrono::seconds(1));
+            if (seq != seen_seq) {
+                seen_seq = seq;
+                last_change = Clock::now();
+            } else if (stats.queue_size == 0 && Clock::now() - last_change > std::chrono::seconds(10)) {
+                std::cerr << "Warning: " << (stats.total_received - stats.total_processed)
+                          << " uploads were never written out" << std::endl;
+                break;
+            }
+        }
+
+        double seconds = std::chrono::duration<double>(Clock::now() - round_start).count();
+        double user_after, system_after;
+        processCpu(user_after, system_after);
+        upload_seconds += seconds;
+        uploaded_bytes += round_bytes;
+        cpu_user += user_after - user_before;
+        cpu_system += system_after - system_before;
+
+        std::cerr << "Round " << round << "/" << options.rounds << ": "
+                  << std::fixed << std::setprecision(1)
+                  << round_bytes / (1024.0 * 1024.0) / seconds << " MB/s" << std::endl;
+
+    }
+
+    grpc_server->Shutdown();
+    server->stop();
+    ServerStatistics stats = server->getStatistics();
+    Logger::instance().flush();
+    std::cout.rdbuf(console);
+
+    double megabytes = uploaded_bytes / (1024.0 * 1024.0);
+    std::cout << "\n=== Loopback Results ===" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Producers:        " << options.producers << " (" << producer.channels << " channels, "
+              << FileWorkQueue::modeName(producer.queue_mode) << ")" << std::endl;
+    std::cout << "Consumers:        " << options.consumers << " (queue " << options.queue_size << ")"
+              << std::endl;
+    std::cout << "Rounds:           " << options.rounds << std::endl;
+    std::cout << "Received:         " << stats.total_received << std::endl;
+    std::cout << "Processed:        " << stats.total_processed << std::endl;
+    std::cout << "Dropped:          " << stats.total_dropped << std::endl;
+    std::cout << "Duplicates:       " << stats.total_duplicates << std::endl;
+    std::cout << "Data:             " << megabytes << " MB" << std::endl;
+    std::cout << "Wall time:        " << upload_seconds << " s" << std::endl;
+    std::cout << "Throughput:       " << (upload_seconds > 0 ? megabytes / upload_seconds : 0)
+              << " MB/s" << std::endl;
+    std::cout << "CPU user/system:  " << cpu_user << " s / " << cpu_system << " s ("
+              << (upload_seconds > 0 ? (cpu_user + cpu_system) / upload_seconds * 100 : 0)
+              << "% of one core)" << std::endl;
+
+    grpc_server.reset();
+    server.reset();
+    if (!options.keep_output) {
+        std::error_code ec;
+        fs::remove_all(scratch, ec);
+    } else {
+        std::cout << "Files kept in:    " << scratch.string() << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,88 @@
+#include "include/memoryBudget.h"
+#include <chrono>
+#include <algorithm>
+
+MemoryBudget::MemoryBudget(size_t limit)
+    : limit_(limit), in_use_(0), peak_(0), waits_(0), waiting_(0), blocked_us_(0),
+      next_ticket_(0) {
+}
+
+void MemoryBudget::setLimit(size_t limit) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        limit_ = limit;
+    }
+    released_cv_.notify_all();
+}
+
+// Nothing held always fits, so the first in line gets through even if
+// the limit was lowered below its request
+bool MemoryBudget::fits(size_t bytes) const {
+    return limit_ == 0 || in_use_ == 0 || in_use_ + bytes <= limit_;
+}
+
+bool MemoryBudget::admits(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return limit_ == 0 || bytes <= limit_;
+}
+
+bool MemoryBudget::acquire(size_t bytes, const std::function<bool()>& cancelled) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    // Anyone already waiting goes first, even if this request would fit
+    if (queue_.empty() && fits(bytes)) {
+        in_use_ += bytes;
+        peak_ = std::max(peak_, in_use_);
+        return true;
+    }
+
+    uint64_t ticket = next_ticket_++;
+    queue_.push_back(ticket);
+    waits_++;
+    waiting_++;
+    auto blocked_since = std::chrono::steady_clock::now();
+
+    // Woken by release(); the timeout is only there to notice cancellation
+    bool granted = false;
+    while (true) {
+        if (queue_.front() == ticket && fits(bytes)) {
+            granted = true;
+            break;
+        }
+        lock.unlock();
+        bool stop = cancelled && cancelled();
+        lock.lock();
+        if (stop) {
+            break;
+        }
+        released_cv_.wait_for(lock, std::chrono::milliseconds(POLL_INTERVAL_MS));
+    }
+
+    queue_.erase(std::find(queue_.begin(), queue_.end(), ticket));
+    waiting_--;
+    blocked_us_ += std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - blocked_since).count();
+    if (granted) {
+        in_use_ += bytes;
+        peak_ = std::max(peak_, in_use_);
+    }
+    lock.unlock();
+    // The next in line may fit as well, or may now be first
+    released_cv_.notify_all();
+    return granted;
+}
+
+void MemoryBudget::release(size_t bytes) {
+    if (bytes == 0) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        in_use_ -= std::min(bytes, in_use_);
+    }
+    released_cv_.notify_all();
+}
+
+MemoryBudgetStats MemoryBudget::stats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return MemoryBudgetStats{limit_, in_use_, peak_, waits_, waiting_, blocked_us_ / 1000};
+}
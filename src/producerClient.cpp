@@ -1,30 +1,129 @@
 #include "include/producerClient.h"
+#include "include/logger.h"
+#include "include/commandLine.h"
 #include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <chrono>
 #include <csignal>
 
+static std::string formatRate(uint64_t bytes_per_sec) {
+    if (bytes_per_sec == 0) {
+        return "unlimited";
+    }
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1) << bytes_per_sec / 1e6 << " MB/s";
+    return out.str();
+}
+
+ProducerClient::ProducerClient(int num_producers, const std::string& base_input_dir,
+                              const std::string& server_address,
+                              const ProducerOptions& options)
+    : ProducerClient(num_producers, base_input_dir, server_address,
+                     std::make_shared<ShardRouter>(splitAddresses(server_address),
+                                                   options.channels),
+                     options) {
+}
+
 ProducerClient::ProducerClient(int num_producers, const std::string& base_input_dir,
-                              const std::string& server_address)
+                              std::shared_ptr<ChannelPool> channels,
+                              const ProducerOptions& options)
+    : ProducerClient(num_producers, base_input_dir, "in-process",
+                     std::make_shared<ShardRouter>("in-process", std::move(channels)),
+                     options) {
+}
+
+ProducerClient::ProducerClient(int num_producers, const std::string& base_input_dir,
+                              const std::string& server_address,
+                              std::shared_ptr<ShardRouter> shards,
+                              const ProducerOptions& options)
     : num_producers_(num_producers), base_input_dir_(base_input_dir),
-      server_address_(server_address) {
-    
-    channel_ = grpc::CreateChannel(server_address_, 
-                                   grpc::InsecureChannelCredentials());
+      server_address_(server_address), options_(options),
+      shards_(std::move(shards)),
+      global_limiter_(std::make_shared<RateLimiter>(options.global_rate)),
+      work_queue_(std::make_shared<FileWorkQueue>(options.queue_mode, num_producers)),
+      journal_(std::make_shared<RetryJournal>()),
+      elapsed_seconds_(0) {
 }
 
 void ProducerClient::start() {
     std::cout << " Media Upload Producer Client" << std::endl;
     std::cout << "Producers:       " << num_producers_ << std::endl;
-    std::cout << "Server:          " << server_address_ << std::endl;
+    if (shards_->size() > 1) {
+        std::cout << "Servers:         " << shards_->size() << " shards, by content hash"
+                  << std::endl;
+        for (int i = 0; i < shards_->size(); i++) {
+            std::cout << "  Shard " << (i + 1) << ":       " << shards_->address(i) << std::endl;
+        }
+        std::cout << "Channels:        " << shards_->channels(0).size() << " per shard"
+                  << std::endl;
+    } else {
+        std::cout << "Server:          " << server_address_ << std::endl;
+        std::cout << "Channels:        " << shards_->channels(0).size() << std::endl;
+    }
     std::cout << "Input directory: " << base_input_dir_ << std::endl;
+    std::cout << "File queue:      " << FileWorkQueue::modeName(options_.queue_mode) << std::endl;
+    std::cout << "Rate/producer:   " << formatRate(options_.producer_rate) << std::endl;
+    std::cout << "Rate (total):    " << formatRate(options_.global_rate) << std::endl;
+    std::cout << "Chunk size:      " << options_.min_chunk_size / 1024 << " KB";
+    if (options_.max_chunk_size != options_.min_chunk_size) {
+        std::cout << " - " << options_.max_chunk_size / 1024 << " KB (adaptive)";
+    }
     std::cout << std::endl;
+    std::cout << "Mode:            " << (options_.watch ? "daemon, watching for new files" : "batch")
+              << std::endl;
 
+    if (!options_.ledger_path.empty()) {
+        ledger_ = std::make_shared<UploadLedger>();
+        if (ledger_->open(options_.ledger_path)) {
+            work_queue_->setLedger(ledger_);
+            std::cout << "Upload record:   " << options_.ledger_path << " ("
+                      << ledger_->uploadedCount() << " files uploaded before)" << std::endl;
+        }
+    }
+
+    // Retries left by the last run go in before the scan, which then
+    // skips those files
+    if (!options_.journal_path.empty()) {
+        journal_->open(options_.journal_path);
+    }
+    work_queue_->setJournal(journal_);
+    size_t replayed = work_queue_->replayJournal();
+    if (!options_.journal_path.empty()) {
+        std::cout << "Retry journal:   " << options_.journal_path << " (" << replayed
+                  << " uploads to retry)" << std::endl;
+    }
+    std::cout << std::endl;
+
+    std::vector<std::string> dirs;
+    for (int i = 0; i < num_producers_; i++) {
+        dirs.push_back(base_input_dir_ + "/producer_" + std::to_string(i + 1));
+    }
+
+    // Watch before scanning so nothing landing in between is missed; the
+    // work queue drops files it has already seen
+    if (options_.watch) {
+        watcher_ = std::make_unique<DirectoryWatcher>([this](int owner, const std::string& path) {
+            if (work_queue_->addFile(owner, path)) {
+                LOG_DEBUG("[PRODUCER-" << (owner + 1) << "] New file: " << path);
+            }
+        });
+        work_queue_->setContinuous(watcher_->start(dirs));
+    }
+
+    // Scan every directory before any thread starts, so work stealing
+    // and the shared queue see the whole batch
+    for (int i = 0; i < num_producers_; i++) {
+        work_queue_->addDirectory(i, dirs[i]);
+    }
+
+    auto batch_start = std::chrono::steady_clock::now();
     for (int i = 0; i < num_producers_; i++) {
-        std::string input_dir = base_input_dir_ + "/producer_" + std::to_string(i + 1);
-        
-        auto producer = std::make_unique<ProducerThread>(i + 1, input_dir, channel_);
+        auto producer = std::make_unique<ProducerThread>(i + 1, work_queue_, shards_,
+                                                         options_, global_limiter_);
         auto* producer_ptr = producer.get();
+        std::lock_guard<std::mutex> lock(producers_mutex_);
         producers_.push_back(std::move(producer));
-        
         threads_.emplace_back([producer_ptr]() { producer_ptr->run(); });
     }
 
@@ -36,16 +135,31 @@ void ProducerClient::start() {
         }
     }
 
+    elapsed_seconds_ = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - batch_start).count();
+    if (watcher_) {
+        watcher_->stop();
+    }
+    shards_->stop();
     printStatistics();
 }
 
 void ProducerClient::stop() {
-    for (auto& producer : producers_) {
-        producer->stop();
+    // Producers waiting for files or retries give up at once; an upload
+    // in flight is finished first. Producers start() adds after this
+    // find the queue stopped and end straight away.
+    work_queue_->stop();
+    {
+        std::lock_guard<std::mutex> lock(producers_mutex_);
+        for (auto& producer : producers_) {
+            producer->stop();
+        }
     }
+    shards_->stop();  // wakes producers waiting for an upload credit
 }
 
 void ProducerClient::printStatistics() {
+    Logger::instance().flush();
     std::cout << "Final Stats" << std::endl;
     
     
@@ -59,6 +173,44 @@ void ProducerClient::printStatistics() {
     
     std::cout << "Total uploaded:  " << total_uploaded << std::endl;
     std::cout << "Total failed:    " << total_failed << std::endl;
+    if (journal_->size() > 0) {
+        std::cout << "Left to retry:   " << journal_->size() << " (kept in "
+                  << options_.journal_path << ")" << std::endl;
+    }
+    if (elapsed_seconds_ > 0) {
+        std::cout << "Batch:           " << work_queue_->totalFiles() << " files, "
+                  << std::fixed << std::setprecision(1)
+                  << work_queue_->totalBytes() / 1e6 << " MB in "
+                  << elapsed_seconds_ << " s ("
+                  << work_queue_->totalBytes() / 1e6 / elapsed_seconds_ << " MB/s)"
+                  << std::endl;
+
+        auto channel_stats = shards_->channels(0).getStatistics();
+        if (shards_->size() > 1) {
+            channel_stats.clear();  // per shard below instead
+        }
+        for (size_t i = 0; channel_stats.size() > 1 && i < channel_stats.size(); i++) {
+            std::cout << "  Channel " << (i + 1) << ":       "
+                      << channel_stats[i].streams << " streams, "
+                      << channel_stats[i].bytes / 1e6 << " MB ("
+                      << channel_stats[i].bytes / 1e6 / elapsed_seconds_ << " MB/s)"
+                      << std::endl;
+        }
+
+        auto shard_stats = shards_->getStatistics();
+        for (size_t i = 0; shard_stats.size() > 1 && i < shard_stats.size(); i++) {
+            const auto& shard = shard_stats[i];
+            std::cout << "  " << shard.address << ": " << shard.uploads << " files, "
+                      << shard.bytes / 1e6 << " MB";
+            if (shard.failovers > 0) {
+                std::cout << " (" << shard.failovers << " failed over from another shard)";
+            }
+            if (shard.failures > 0) {
+                std::cout << ", " << shard.failures << " connection failures";
+            }
+            std::cout << (shard.healthy ? "" : ", down") << std::endl;
+        }
+    }
     
     if (total_uploaded + total_failed > 0) {
         double success_rate = (total_uploaded * 100.0) / (total_uploaded + total_failed);
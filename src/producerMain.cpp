@@ -1,26 +1,60 @@
 #include <iostream>
 #include <string>
 #include <csignal>
+#include <cstdlib>
+#include <thread>
+#include <atomic>
+#include <chrono>
 #include "include/producerClient.h"
+#include "include/logger.h"
+#include "include/commandLine.h"
 
 std::unique_ptr<ProducerClient> producer_client;
 
-void signalHandler(int signum) {
-    std::cout << "\n\nShutting down producers..." << std::endl;
-    
-    if (producer_client) {
-        producer_client->stop();
+volatile std::sig_atomic_t shutdown_requested = 0;
+
+// Only sets the flag; main's shutdown thread stops the producers, and
+// uploads in flight finish. A second Ctrl+C exits at once.
+void signalHandler(int) {
+    if (shutdown_requested) {
+        std::_Exit(1);
     }
-    
-    exit(0);
+    shutdown_requested = 1;
 }
 
 void printUsage(const char* program_name) {
-    std::cout << "Usage: " << program_name << " -p <producers> [-s <server>] [-i <input_dir>]\n";
+    std::cout << "Usage: " << program_name << " -p <producers> [-s <server>] [-i <input_dir>]"
+              << " [-r <rate>] [-g <rate>] [-n] [-c <min>[:<max>]] [-m <mode>] [-k <channels>]"
+              << " [-d] [-l <file>] [-j <file>] [-L <level>] [-R <count>] [-t <rate>]\n";
     std::cout << "\nOptions:\n";
     std::cout << "  -p <producers>    Number of producer threads (required)\n";
-    std::cout << "  -s <server>       Server address (default: localhost:50051)\n";
+    std::cout << "  -s <server>       Server address (default: localhost:50051); a comma-separated\n";
+    std::cout << "                    list shards files over several servers by content hash,\n";
+    std::cout << "                    moving to the next one while a server is down\n";
     std::cout << "  -i <input_dir>    Base input directory (default: ./video_files)\n";
+    std::cout << "  -r <rate>         Upload limit per producer in bytes/sec (default: unlimited)\n";
+    std::cout << "  -g <rate>         Upload limit across all producers in bytes/sec (default: unlimited)\n";
+    std::cout << "  -n                No random 2-5 s pause between files\n";
+    std::cout << "  -c <min>[:<max>]  Chunk size bounds in bytes (default: 16K:1M, adapted to\n";
+    std::cout << "                    the link); a single value fixes the chunk size\n";
+    std::cout << "  -k <channels>     Connections to the server, shared by all producers (default: 1)\n";
+    std::cout << "  -m <mode>         How files are shared between producers (default: dir):\n";
+    std::cout << "                      dir     each producer uploads only its own directory\n";
+    std::cout << "                      steal   own directory largest-first, then help the others\n";
+    std::cout << "                      shared  one queue of all files, largest-first\n";
+    std::cout << "  -d                Daemon mode: keep running and upload new files as they land\n";
+    std::cout << "  -l <file>         Record of uploaded files, never sent again after a restart\n";
+    std::cout << "                    (default with -d: <input_dir>/.uploaded)\n";
+    std::cout << "  -j <file>         Journal of failed uploads, retried with backoff and again\n";
+    std::cout << "                    after a restart (default: <input_dir>/.retries)\n";
+    std::cout << "  -L <level>        Log level: debug, info, warn, error or off (default: info);\n";
+    std::cout << "                    per-file and per-chunk progress is logged at debug\n";
+    std::cout << "  -R <count>        Max messages per second from one log statement, 0 = no\n";
+    std::cout << "                    limit (default: 100)\n";
+    std::cout << "  -t <rate>         Share of uploads to trace, 0-1 (default: 0.01); the server\n";
+    std::cout << "                    shows the traces at /api/trace\n";
+    std::cout << "\nRates accept K, M and G suffixes (powers of 1000), e.g. 50M; 0 means unlimited.\n";
+    std::cout << "Chunk sizes accept K and M suffixes (powers of 1024), up to 8M.\n";
     std::cout << "\nInput Directory Structure:\n";
     std::cout << "  The base directory should contain subdirectories for each producer:\n";
     std::cout << "    <input_dir>/producer_1/\n";
@@ -29,12 +63,41 @@ void printUsage(const char* program_name) {
     std::cout << "\nExample:\n";
     std::cout << "  " << program_name << " -p 3\n";
     std::cout << "  " << program_name << " -p 5 -s 192.168.1.100:50051 -i /path/to/videos\n";
+    std::cout << "  " << program_name << " -p 8 -g 1.25G -n\n";
+    std::cout << "  " << program_name << " -p 2 -c 64K\n";
+    std::cout << "  " << program_name << " -p 8 -m shared -n\n";
+    std::cout << "  " << program_name << " -p 4 -s host1:50051,host2:50051,host3:50051\n";
+    std::cout << "  " << program_name << " -p 50 -k 8 -m steal\n";
+    std::cout << "  " << program_name << " -p 4 -d -n -i /srv/camera_drops\n";
+    std::cout << "  " << program_name << " -p 3 -L debug\n";
+}
+
+// Parses "<min>[:<max>]" chunk size bounds into options
+bool parseChunkSizes(const std::string& text, ProducerOptions& options) {
+    size_t colon = text.find(':');
+    uint64_t min_size, max_size;
+    if (!parseQuantity(text.substr(0, colon), 1024, min_size)) {
+        return false;
+    }
+    if (colon == std::string::npos) {
+        max_size = min_size;
+    } else if (!parseQuantity(text.substr(colon + 1), 1024, max_size)) {
+        return false;
+    }
+
+    if (min_size < 1024 || min_size > max_size || max_size > ProducerThread::MAX_CHUNK_SIZE) {
+        return false;
+    }
+    options.min_chunk_size = min_size;
+    options.max_chunk_size = max_size;
+    return true;
 }
 
 int main(int argc, char** argv) {
     int num_producers = 0;
     std::string server_address = "localhost:50051";
     std::string base_input_dir = "./video_files";
+    ProducerOptions options;
 
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
@@ -46,6 +109,50 @@ int main(int argc, char** argv) {
             server_address = argv[++i];
         } else if (arg == "-i" && i + 1 < argc) {
             base_input_dir = argv[++i];
+        } else if ((arg == "-r" || arg == "-g") && i + 1 < argc) {
+            uint64_t& rate = arg == "-r" ? options.producer_rate : options.global_rate;
+            if (!parseQuantity(argv[++i], 1000, rate)) {
+                std::cerr << "Error: Invalid rate for " << arg << ": " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "-d") {
+            options.watch = true;
+        } else if (arg == "-l" && i + 1 < argc) {
+            options.ledger_path = argv[++i];
+        } else if (arg == "-j" && i + 1 < argc) {
+            options.journal_path = argv[++i];
+        } else if (arg == "-L" && i + 1 < argc) {
+            LogLevel level;
+            if (!Logger::parseLevel(argv[++i], level)) {
+                std::cerr << "Error: Unknown log level: " << argv[i]
+                          << " (expected debug, info, warn, error or off)" << std::endl;
+                return 1;
+            }
+            Logger::setLevel(level);
+        } else if (arg == "-R" && i + 1 < argc) {
+            Logger::setRateLimit(std::stoi(argv[++i]));
+        } else if (arg == "-t" && i + 1 < argc) {
+            options.trace_rate = std::stod(argv[++i]);
+            if (options.trace_rate < 0 || options.trace_rate > 1) {
+                std::cerr << "Error: Trace sample rate must be between 0 and 1" << std::endl;
+                return 1;
+            }
+        } else if (arg == "-n") {
+            options.pause_between_files = false;
+        } else if (arg == "-k" && i + 1 < argc) {
+            options.channels = std::stoi(argv[++i]);
+        } else if (arg == "-m" && i + 1 < argc) {
+            if (!FileWorkQueue::parseMode(argv[++i], options.queue_mode)) {
+                std::cerr << "Error: Unknown file queue mode: " << argv[i]
+                          << " (expected dir, steal or shared)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "-c" && i + 1 < argc) {
+            if (!parseChunkSizes(argv[++i], options)) {
+                std::cerr << "Error: Invalid chunk sizes: " << argv[i]
+                          << " (expected <min>[:<max>] between 1K and 8M)" << std::endl;
+                return 1;
+            }
         } else if (arg == "-h" || arg == "--help") {
             printUsage(argv[0]);
             return 0;
@@ -68,6 +175,24 @@ int main(int argc, char** argv) {
         return 1;
     }
 
+    if (options.channels < 1 || options.channels > num_producers) {
+        std::cerr << "Error: Number of channels must be between 1 and the number of producers"
+                  << std::endl;
+        return 1;
+    }
+
+    if (splitAddresses(server_address).empty()) {
+        std::cerr << "Error: No server address given" << std::endl;
+        return 1;
+    }
+
+    if (options.watch && options.ledger_path.empty()) {
+        options.ledger_path = base_input_dir + "/.uploaded";
+    }
+    if (options.journal_path.empty()) {
+        options.journal_path = base_input_dir + "/.retries";
+    }
+
     // Set up signal handler
     signal(SIGINT, signalHandler);
     signal(SIGTERM, signalHandler);
@@ -79,10 +204,24 @@ int main(int argc, char** argv) {
 
     // Create and start producer client
     producer_client = std::make_unique<ProducerClient>(
-        num_producers, base_input_dir, server_address
+        num_producers, base_input_dir, server_address, options
     );
 
-    producer_client->start();
+    std::atomic<bool> finished(false);
+    std::thread shutdown_thread([&finished]() {
+        while (!shutdown_requested && !finished) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        if (shutdown_requested) {
+            std::cout << "\n\nShutting down producers, letting uploads in flight finish"
+                      << " (Ctrl+C again to quit now)..." << std::endl;
+            producer_client->stop();
+        }
+    });
+
+    producer_client->start();  // returns once every producer thread is done
+    finished = true;
+    shutdown_thread.join();
 
     return 0;
 }
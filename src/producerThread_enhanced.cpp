@@ -1,4 +1,6 @@
 #include "include/producerThread.h"
+#include "include/inputFile.h"
+#include "include/logger.h"
 #include <iostream>
 #include <fstream>
 #include <filesystem>
@@ -6,16 +8,28 @@
 #include <chrono>
 #include <random>
 #include <algorithm>
+#include <openssl/sha.h>
+#include <openssl/evp.h>
 #include <grpcpp/grpcpp.h>
 #include "media_service.grpc.pb.h"
+
+#ifdef __linux__
+    #include <pthread.h>
+#endif
     
 namespace fs = std::filesystem;
 
-ProducerThread::ProducerThread(int id, const std::string& input_dir,
-                              std::shared_ptr<Channel> channel)
-    : producer_id_(id), input_dir_(input_dir), channel_(channel),
-      stub_(mediaupload::MediaUploadService::NewStub(channel)),
-      running_(true), uploaded_count_(0), failed_count_(0) {}
+ProducerThread::ProducerThread(int id, std::shared_ptr<FileWorkQueue> work_queue,
+                              std::shared_ptr<ShardRouter> shards,
+                              const ProducerOptions& options,
+                              std::shared_ptr<RateLimiter> global_limiter)
+    : producer_id_(id), work_queue_(std::move(work_queue)), shards_(std::move(shards)),
+      options_(options), rate_limiter_(options.producer_rate),
+      global_limiter_(std::move(global_limiter)),
+      chunk_sizer_(options.min_chunk_size, options.max_chunk_size, INITIAL_CHUNK_SIZE),
+      read_ahead_(std::max(READ_AHEAD_SIZE, PIPELINE_DEPTH * options.max_chunk_size)),
+      running_(true), use_upload_frames_(true),
+      uploaded_count_(0), failed_count_(0), taken_count_(0) {}
 
 std::string ProducerThread::generateVideoId() {
     auto now = std::chrono::system_clock::now();
@@ -30,43 +44,6 @@ std::string ProducerThread::generateVideoId() {
            std::to_string(timestamp) + "_" + std::to_string(dis(gen));
 }
 
-bool ProducerThread::isVideoFile(const std::string& filename) {
-    std::string lower = filename;
-    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
-    
-    const std::vector<std::string> extensions = {
-        ".mp4", ".avi", ".mov", ".mkv", ".flv", ".wmv", ".webm", ".m4v"
-    };
-    
-    for (const auto& ext : extensions) {
-        if (lower.size() >= ext.size() &&
-            lower.substr(lower.size() - ext.size()) == ext) {
-            return true;
-        }
-    }
-    return false;
-}
-
-std::vector<std::string> ProducerThread::getVideoFiles() {
-    std::vector<std::string> files;
-    
-    if (!fs::exists(input_dir_)) {
-        std::cerr << "[PRODUCER-" << producer_id_ << "] Directory not found: " 
-                  << input_dir_ << std::endl;
-        return files;
-    }
-
-    for (const auto& entry : fs::directory_iterator(input_dir_)) {
-        if (entry.is_regular_file() && isVideoFile(entry.path().filename().string())) {
-            files.push_back(entry.path().string());
-        }
-    }
-    
-    std::cout << "[PRODUCER-" << producer_id_ << "] Found " << files.size() 
-              << " video files in " << input_dir_ << std::endl;
-    return files;
-}
-
 std::string ProducerThread::formatFileSize(size_t size) {
     const char* units[] = {"B", "KB", "MB", "GB"};
     int unit = 0;
@@ -83,133 +60,433 @@ std::string ProducerThread::formatFileSize(size_t size) {
 }
 
 // BONUS FEATURE #1: Producer can check if queue is full
-bool ProducerThread::checkQueueStatus() {
+bool ProducerThread::checkQueueStatus(int shard) {
     ClientContext context;
     mediaupload::QueueStatusRequest request;
     mediaupload::QueueStatusResponse response;
     
-    Status status = stub_->GetQueueStatus(&context, request, &response);
+    Status status = shards_->channels(shard).stub(producer_id_ - 1)->GetQueueStatus(
+        &context, request, &response);
     
     if (status.ok()) {
-        std::cout << "[PRODUCER-" << producer_id_ << "] Queue status: " 
-                  << response.current_size() << "/" << response.max_size();
-        
         if (response.is_full()) {
-            std::cout << " ⚠️  FULL!" << std::endl;
+            LOG_DEBUG("[PRODUCER-" << producer_id_ << "] Queue status: "
+                      << response.current_size() << "/" << response.max_size() << " ⚠️  FULL!");
             return false;
         }
-        std::cout << " (" << response.available_slots() << " slots available)" << std::endl;
+        LOG_DEBUG("[PRODUCER-" << producer_id_ << "] Queue status: "
+                  << response.current_size() << "/" << response.max_size()
+                  << " (" << response.available_slots() << " slots available)");
         return true;
     }
     
     return true; // Assume queue is available if check fails
 }
 
-bool ProducerThread::uploadVideo(const std::string& filepath) {
-    // BONUS FEATURE #1: Check queue before uploading
-    if (!checkQueueStatus()) {
-        std::cout << "[PRODUCER-" << producer_id_ << "] Queue is full, waiting 2s..." << std::endl;
-        std::this_thread::sleep_for(std::chrono::seconds(2));
-        failed_count_++;
+// Empty if the file shrank while it was being hashed
+static std::string hashFile(const InputFile& file) {
+    static constexpr size_t STEP = 1024 * 1024;
+    std::vector<char> buffer(std::min(STEP, file.size()));
+    std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> sha(EVP_MD_CTX_new(), EVP_MD_CTX_free);
+    EVP_DigestInit_ex(sha.get(), EVP_sha256(), nullptr);
+    for (size_t offset = 0; offset < file.size(); offset += STEP) {
+        size_t step = std::min(STEP, file.size() - offset);
+        if (!file.read(offset, step, buffer.data())) {
+            return "";
+        }
+        EVP_DigestUpdate(sha.get(), buffer.data(), step);
+    }
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    EVP_DigestFinal_ex(sha.get(), digest, nullptr);
+    char hex[SHA256_DIGEST_LENGTH * 2 + 1];
+    for (int i = 0; i < SHA256_DIGEST_LENGTH; i++) {
+        snprintf(hex + i * 2, 3, "%02x", digest[i]);
+    }
+    return std::string(hex, SHA256_DIGEST_LENGTH * 2);
+}
+
+bool ProducerThread::uploadVideo(const FileTask& task) {
+    const std::string& filepath = task.path;
+    InputFile file;
+    if (!file.open(filepath)) {
+        LOG_ERROR("[PRODUCER-" << producer_id_ << "] Failed to open: "
+                  << filepath);
+        finishTask(task, UploadOutcome::Permanent);
         return false;
     }
 
-    std::ifstream file(filepath, std::ios::binary | std::ios::ate);
-    if (!file) {
-        std::cerr << "[PRODUCER-" << producer_id_ << "] Failed to open: " 
-                  << filepath << std::endl;
+    // Sampled uploads are traced on both sides; the server picks the id
+    // up from the request metadata
+    uint64_t trace_id = Tracer::sample(options_.trace_rate);
+    int64_t wait_start_us = trace_id ? Tracer::nowMicros() : 0;
+
+    // With several servers the file's hash decides where it goes, so it
+    // is computed up front; the pages stay cached for the send
+    std::string content_hash;
+    int shard = 0;
+    bool failover = false;
+    if (shards_->size() > 1) {
+        content_hash = hashFile(file);
+        if (content_hash.empty()) {
+            LOG_WARN("[PRODUCER-" << producer_id_ << "] File shrank while it was being hashed: "
+                     << filepath);
+            finishTask(task, UploadOutcome::Transient);
+            return false;
+        }
+        shard = shards_->pick(content_hash, failover);
+        LOG_DEBUG("[PRODUCER-" << producer_id_ << "] Shard " << (shard + 1) << " ("
+                  << shards_->address(shard) << ")" << (failover ? ", failing over" : ""));
+    }
+
+    // Wait for the server to reserve a queue slot; only servers without
+    // Subscribe (or the legacy upload stream) need the queue polled
+    uint64_t credit_id = 0;
+    UploadCredits& credits = shards_->credits(shard);
+    if (use_upload_frames_ && credits.acquire()) {
+        credit_id = credits.subscriptionId();
+    } else if (!running_) {
+        finishTask(task, UploadOutcome::Transient);
+        return false;
+    } else if (!checkQueueStatus(shard)) {
+        // BONUS FEATURE #1: Check queue before uploading
+        LOG_DEBUG("[PRODUCER-" << producer_id_ << "] Queue is full");
+        finishTask(task, UploadOutcome::Capacity);
         return false;
     }
 
-    size_t file_size = file.tellg();
-    file.seekg(0, std::ios::beg);
+    size_t file_size = file.size();
 
     std::string filename = fs::path(filepath).filename().string();
     std::string video_id = generateVideoId();
 
-    std::cout << "\n[PRODUCER-" << producer_id_ << "] Starting upload: " 
-              << filename << " (" << formatFileSize(file_size) << ")" << std::endl;
-    std::cout << "[PRODUCER-" << producer_id_ << "] Video ID: " << video_id << std::endl;
+    LOG_DEBUG("[PRODUCER-" << producer_id_ << "] Starting upload: "
+              << filename << " (" << formatFileSize(file_size) << ")");
+    LOG_DEBUG("[PRODUCER-" << producer_id_ << "] Video ID: " << video_id);
 
-    ClientContext context;
-    mediaupload::UploadResponse response;
-    std::unique_ptr<ClientWriter<mediaupload::VideoChunk>> writer(
-        stub_->UploadVideo(&context, &response));
+    if (!use_upload_frames_) {
+        ChannelPool::Lease lease = shards_->channels(shard).acquire();
+        mediaupload::UploadResponse response;
+        Status status = sendChunks(lease, file, video_id, filename, trace_id, &response);
+        return reportResult(task, shard, failover, status, response);
+    }
 
-    std::vector<char> buffer(CHUNK_SIZE);
-    int chunk_number = 0;
-    size_t total_sent = 0;
+    auto upload = std::make_unique<PendingUpload>();
+    upload->lease = shards_->channels(shard).acquire();
+    upload->task = task;
+    upload->shard = shard;
+    upload->failover = failover;
+    upload->filename = filename;
+    upload->trace_id = trace_id;
+    upload->wait_start_us = wait_start_us;
+    upload->wait_end_us = trace_id ? Tracer::nowMicros() : 0;
+    return sendFrames(file, video_id, credit_id, content_hash, std::move(upload));
+}
 
-    while (file.read(buffer.data(), CHUNK_SIZE) || file.gcount() > 0) {
-        size_t bytes_read = file.gcount();
-        
-        mediaupload::VideoChunk chunk;
-        chunk.set_video_id(video_id);
-        chunk.set_filename(filename);
-        chunk.set_data(buffer.data(), bytes_read);
-        chunk.set_chunk_number(chunk_number++);
-        chunk.set_producer_id(producer_id_);
-        chunk.set_total_size(file_size);
-        
-        if (file.peek() == EOF) {
-            chunk.set_is_last(true);
-        } else {
-            chunk.set_is_last(false);
-        }
+void ProducerThread::finishPending() {
+    if (!pending_) {
+        return;
+    }
+    auto upload = std::move(pending_);
+    Status status = upload->status.get();
+    handleFramedResult(*upload, status);
+}
 
-        if (!writer->Write(chunk)) {
-            std::cerr << "[PRODUCER-" << producer_id_ << "] Failed to write chunk " 
-                      << chunk_number << std::endl;
-            return false;
+void ProducerThread::sendFallbacks() {
+    while (!fallback_.empty()) {
+        FileTask task = fallback_.front();
+        fallback_.pop_front();
+        uploadVideo(task);
+    }
+}
+
+bool ProducerThread::handleFramedResult(PendingUpload& upload, const Status& status) {
+    if (status.error_code() == grpc::StatusCode::UNIMPLEMENTED) {
+        if (use_upload_frames_) {
+            LOG_INFO("[PRODUCER-" << producer_id_ << "] Server does not support "
+                     << "framed uploads, using per-chunk metadata");
         }
+        use_upload_frames_ = false;
+        // Sent again by run(), not from here: this may be called while the
+        // next file's stream is open
+        fallback_.push_back(upload.task);
+        return true;
+    }
+    return reportResult(upload.task, upload.shard, upload.failover, status, upload.response);
+}
 
-        total_sent += bytes_read;
-        
-        if (chunk_number % 10 == 0) {
-            int progress = static_cast<int>((total_sent * 100) / file_size);
-            std::cout << "[PRODUCER-" << producer_id_ << "] Progress: " 
-                      << progress << "% (" << formatFileSize(total_sent) 
-                      << "/" << formatFileSize(file_size) << ")" << std::endl;
+// Decides whether a failed upload is worth retrying, and how soon
+static UploadOutcome classifyResult(const Status& status,
+                                    const mediaupload::UploadResponse& response) {
+    if (status.ok()) {
+        switch (response.result()) {
+            case mediaupload::UploadResponse::QUEUED:
+            case mediaupload::UploadResponse::DUPLICATE:
+                // A duplicate is already on the server, so it counts as
+                // delivered and will not be sent again
+                return UploadOutcome::Delivered;
+            case mediaupload::UploadResponse::QUEUE_FULL:
+                return UploadOutcome::Capacity;
+            case mediaupload::UploadResponse::NO_DATA:
+                return UploadOutcome::Permanent;  // an empty file stays empty
+            case mediaupload::UploadResponse::CHECKSUM_MISMATCH:
+                return UploadOutcome::Transient;
+            default:
+                // An older server only says whether it worked
+                return response.success() ? UploadOutcome::Delivered : UploadOutcome::Transient;
         }
+    }
 
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    switch (status.error_code()) {
+        case grpc::StatusCode::RESOURCE_EXHAUSTED:
+            return UploadOutcome::Capacity;
+        case grpc::StatusCode::INVALID_ARGUMENT:
+        case grpc::StatusCode::NOT_FOUND:
+        case grpc::StatusCode::ALREADY_EXISTS:
+        case grpc::StatusCode::PERMISSION_DENIED:
+        case grpc::StatusCode::UNAUTHENTICATED:
+        case grpc::StatusCode::FAILED_PRECONDITION:
+        case grpc::StatusCode::OUT_OF_RANGE:
+        case grpc::StatusCode::UNIMPLEMENTED:
+            return UploadOutcome::Permanent;
+        default:
+            return UploadOutcome::Transient;  // UNAVAILABLE, DEADLINE_EXCEEDED, broken streams
     }
+}
 
-    writer->WritesDone();
-    Status status = writer->Finish();
+void ProducerThread::finishTask(const FileTask& task, UploadOutcome outcome) {
+    int attempt = 0;
+    std::chrono::milliseconds delay(0);
+    bool retry = work_queue_->complete(task, outcome, attempt, delay);
+
+    // Only a file given up on counts as failed, not each attempt at it
+    if (outcome != UploadOutcome::Delivered && !retry) {
+        failed_count_++;
+    }
+    if (outcome == UploadOutcome::Delivered || outcome == UploadOutcome::Permanent) {
+        return;
+    }
+    std::string filename = fs::path(task.path).filename().string();
+    if (retry) {
+        LOG_DEBUG("[PRODUCER-" << producer_id_ << "] ↻ Retrying " << filename
+                  << " in " << delay.count() << " ms (attempt " << attempt << ", "
+                  << (outcome == UploadOutcome::Capacity ? "server busy" : "transient error")
+                  << ")");
+    } else {
+        LOG_WARN("[PRODUCER-" << producer_id_ << "] Giving up on " << filename
+                 << " after " << (attempt - 1) << " retries; it stays in the retry journal"
+                 << " for the next start");
+    }
+}
+
+bool ProducerThread::reportResult(const FileTask& task, int shard, bool failover,
+                                  const Status& status,
+                                  const mediaupload::UploadResponse& response) {
+    std::string filename = fs::path(task.path).filename().string();
+    UploadOutcome outcome = classifyResult(status, response);
+    // A server that can't be reached is skipped for a while; the retry
+    // then goes to the next shard
+    shards_->recordResult(shard, status.error_code() != grpc::StatusCode::UNAVAILABLE,
+                          outcome == UploadOutcome::Delivered, task.size, failover);
 
     if (status.ok() && response.success()) {
-        std::cout << "[PRODUCER-" << producer_id_ << "] ✓ Uploaded: " 
-                  << filename << std::endl;
-        std::cout << "[PRODUCER-" << producer_id_ << "] Server: " 
-                  << response.message() << std::endl;
+        LOG_DEBUG("[PRODUCER-" << producer_id_ << "] ✓ Uploaded: "
+                  << filename);
+        LOG_DEBUG("[PRODUCER-" << producer_id_ << "] Server: "
+                  << response.message());
         uploaded_count_++;
+        finishTask(task, outcome);
         return true;
     } else {
-        std::cerr << "[PRODUCER-" << producer_id_ << "] ❌ Upload failed: " 
-                  << filename << std::endl;
+        LOG_WARN("[PRODUCER-" << producer_id_ << "] ❌ Upload failed: "
+                 << filename);
         if (!status.ok()) {
-            std::cerr << "[PRODUCER-" << producer_id_ << "] gRPC error: " 
-                      << status.error_message() << std::endl;
+            LOG_WARN("[PRODUCER-" << producer_id_ << "] gRPC error: "
+                     << status.error_message());
         } else {
-            std::cerr << "[PRODUCER-" << producer_id_ << "] Server error: " 
-                      << response.message() << std::endl;
+            LOG_WARN("[PRODUCER-" << producer_id_ << "] Server error: "
+                     << response.message());
         }
-        failed_count_++;
+        finishTask(task, outcome);
         return false;
     }
 }
 
+bool ProducerThread::streamFile(const InputFile& file, bool hash, std::string* buffer,
+                                const std::function<bool(size_t, bool)>& write_chunk) {
+    size_t file_size = file.size();
+    int chunk_number = 0;
+    size_t total_sent = 0;
+    size_t next_progress = PROGRESS_INTERVAL;
+    read_ahead_.start(file, hash);
+
+    while (total_sent < file_size) {
+        size_t chunk_bytes = std::min(chunk_sizer_.chunkSize(), file_size - total_sent);
+
+        // Usually a no-op: the read-ahead thread is already past this chunk
+        bool readable = read_ahead_.waitFor(total_sent + chunk_bytes);
+
+        rate_limiter_.acquire(chunk_bytes);
+        global_limiter_->acquire(chunk_bytes);
+
+        // Read after the limiters, so the chunk is what the file holds now
+        buffer->resize(chunk_bytes);
+        if (!readable || !file.read(total_sent, chunk_bytes, &(*buffer)[0])) {
+            LOG_WARN("[PRODUCER-" << producer_id_ << "] File shrank while it was being sent");
+            read_ahead_.cancel();
+            return false;
+        }
+
+        chunk_number++;
+        auto write_start = std::chrono::steady_clock::now();
+        if (!write_chunk(chunk_bytes, total_sent + chunk_bytes == file_size)) {
+            LOG_WARN("[PRODUCER-" << producer_id_ << "] Failed to write chunk "
+                     << chunk_number);
+            read_ahead_.cancel();
+            return false;
+        }
+        chunk_sizer_.recordWrite(chunk_bytes, std::chrono::steady_clock::now() - write_start);
+
+        total_sent += chunk_bytes;
+        
+        if (total_sent >= next_progress) {
+            next_progress = total_sent + PROGRESS_INTERVAL;
+            int progress = static_cast<int>((total_sent * 100) / file_size);
+            LOG_DEBUG("[PRODUCER-" << producer_id_ << "] Progress: "
+                      << progress << "% (" << formatFileSize(total_sent)
+                      << "/" << formatFileSize(file_size) << ")");
+        }
+    }
+
+    read_ahead_.cancel();
+
+    if (!chunk_sizer_.isFixed()) {
+        LOG_DEBUG("[PRODUCER-" << producer_id_ << "] Chunk size now "
+                  << formatFileSize(chunk_sizer_.chunkSize()));
+    }
+    return true;
+}
+
+// Reports a producer-side stage of a traced upload to the server
+static void addSpan(mediaupload::UploadFrame& frame, const char* name,
+                    int64_t start_us, int64_t end_us) {
+    auto* span = frame.add_spans();
+    span->set_name(name);
+    span->set_start_us(start_us);
+    span->set_duration_us(end_us - start_us);
+}
+
+bool ProducerThread::sendFrames(const InputFile& file, const std::string& video_id,
+                                uint64_t credit_id, const std::string& content_hash,
+                                std::unique_ptr<PendingUpload> upload) {
+    if (upload->trace_id) {
+        upload->context.AddMetadata(Tracer::METADATA_KEY, Tracer::formatId(upload->trace_id));
+    }
+    int64_t send_start_us = upload->trace_id ? Tracer::nowMicros() : 0;
+    upload->writer = upload->lease.stub()->UploadVideoFrames(&upload->context,
+                                                             &upload->response);
+
+    // The metadata travels once, in the header frame
+    mediaupload::UploadFrame frame;
+    auto* header = frame.mutable_header();
+    header->set_video_id(video_id);
+    header->set_filename(upload->filename);
+    header->set_producer_id(producer_id_);
+    header->set_total_size(file.size());
+    header->set_credit_id(credit_id);
+    frame.set_is_last(file.size() == 0);
+    bool sent = upload->writer->Write(frame);
+
+    // This stream is open; by now the previous file's reply has usually arrived
+    finishPending();
+
+    // Data frames reuse the message, so the data field keeps its capacity
+    // and each chunk costs a single copy, read from the page cache into it.
+    // The last one carries the hash the read-ahead computed on the way.
+    if (sent) {
+        sent = streamFile(file, content_hash.empty(), frame.mutable_data(),
+                          [&](size_t size, bool is_last) {
+            frame.set_is_last(is_last);
+            if (is_last) {
+                frame.set_sha256(content_hash.empty() ? read_ahead_.digest() : content_hash);
+                if (upload->trace_id) {
+                    addSpan(frame, "slot_wait", upload->wait_start_us, upload->wait_end_us);
+                    addSpan(frame, "send", send_start_us, Tracer::nowMicros());
+                }
+            }
+            upload->lease.addBytes(size);
+            return upload->writer->Write(frame);
+        });
+    }
+    upload->writer->WritesDone();
+
+    if (!sent) {
+        // Settle a broken stream right away, so an old server is detected
+        // before the next file
+        Status status = upload->writer->Finish();
+        return handleFramedResult(*upload, status);
+    }
+
+    // Collect the reply in the background while the next file starts
+    auto* writer = upload->writer.get();
+    upload->status = std::async(std::launch::async, [writer]() { return writer->Finish(); });
+    pending_ = std::move(upload);
+    return true;
+}
+
+Status ProducerThread::sendChunks(ChannelPool::Lease& lease,
+                                  const InputFile& file, const std::string& video_id,
+                                  const std::string& filename, uint64_t trace_id,
+                                  mediaupload::UploadResponse* response) {
+    ClientContext context;
+    if (trace_id) {
+        context.AddMetadata(Tracer::METADATA_KEY, Tracer::formatId(trace_id));
+    }
+    std::unique_ptr<ClientWriter<mediaupload::VideoChunk>> writer(
+        lease.stub()->UploadVideo(&context, response));
+
+    mediaupload::VideoChunk chunk;
+    chunk.set_video_id(video_id);
+    chunk.set_filename(filename);
+    chunk.set_producer_id(producer_id_);
+    chunk.set_total_size(file.size());
+
+    int chunk_number = 0;
+    bool sent;
+    if (file.size() == 0) {
+        // Nothing to stream, but the server still needs a last chunk to
+        // know the upload is whole
+        chunk.set_is_last(true);
+        sent = writer->Write(chunk);
+    } else {
+        // Legacy uploads carry no hash
+        sent = streamFile(file, false, chunk.mutable_data(), [&](size_t size, bool is_last) {
+            chunk.set_chunk_number(chunk_number++);
+            chunk.set_is_last(is_last);
+            lease.addBytes(size);
+            return writer->Write(chunk);
+        });
+    }
+
+    if (!sent) {
+        // The file shrank, or the stream broke; a broken stream already
+        // has the server's status, which Finish() reports
+        context.TryCancel();
+        return writer->Finish();
+    }
+    writer->WritesDone();
+    return writer->Finish();
+}
+
 void ProducerThread::run() {
-    std::cout << "[PRODUCER-" << producer_id_ << "] Thread started" << std::endl;
-    std::cout << "[PRODUCER-" << producer_id_ << "] Input directory: " 
-              << input_dir_ << std::endl;
+#ifdef __linux__
+    pthread_setname_np(pthread_self(), ("producer-" + std::to_string(producer_id_)).c_str());
+#endif
+    LOG_INFO("[PRODUCER-" << producer_id_ << "] Thread started");
 
-    auto video_files = getVideoFiles();
-    
-    if (video_files.empty()) {
-        std::cerr << "[PRODUCER-" << producer_id_ 
-                  << "] No video files found. Exiting." << std::endl;
+    const int index = producer_id_ - 1;
+    if (!work_queue_->hasWork(index) && !work_queue_->isContinuous()) {
+        LOG_WARN("[PRODUCER-" << producer_id_
+                 << "] No video files found. Exiting.");
         return;
     }
 
@@ -217,29 +494,47 @@ void ProducerThread::run() {
     std::mt19937 gen(rd());
     std::uniform_int_distribution<> dis(2000, 5000);
 
-    size_t file_index = 0;
-    while (running_ && file_index < video_files.size()) {
-        const std::string& video_file = video_files[file_index];
-        
-        std::cout << "\n[PRODUCER-" << producer_id_ << "] Preparing file " 
-                  << (file_index + 1) << "/" << video_files.size() << std::endl;
-        
-        uploadVideo(video_file);
+    int file_number = 0;
+    FileTask task;
+    while (running_) {
+        sendFallbacks();
+        // Settle the last reply before waiting: it may be the failure
+        // that brings a retry, and in daemon mode the wait can be long
+        if (!work_queue_->tryNext(index, task)) {
+            finishPending();
+            sendFallbacks();
+            if (!work_queue_->next(index, task)) {
+                break;
+            }
+        }
+        file_number++;
+        if (task.owner != index) {
+            taken_count_++;
+        }
+        LOG_DEBUG("[PRODUCER-" << producer_id_ << "] Preparing file "
+                  << file_number << " (" << formatFileSize(task.size) << ")"
+                  << (task.owner != index ? " from producer_" + std::to_string(task.owner + 1) : ""));
         
-        file_index++;
+        uploadVideo(task);
         
-        if (file_index < video_files.size() && running_) {
+        if (options_.pause_between_files && running_ && work_queue_->hasWork(index)) {
             int wait_time = dis(gen);
-            std::cout << "[PRODUCER-" << producer_id_ << "] Waiting " 
-                      << wait_time << "ms..." << std::endl;
+            LOG_DEBUG("[PRODUCER-" << producer_id_ << "] Waiting "
+                      << wait_time << "ms...");
             std::this_thread::sleep_for(std::chrono::milliseconds(wait_time));
         }
     }
 
-    std::cout << "\n[PRODUCER-" << producer_id_ << "] Thread finished" << std::endl;
-    std::cout << "[PRODUCER-" << producer_id_ << "] Statistics:" << std::endl;
-    std::cout << "  - Successful: " << uploaded_count_ << std::endl;
-    std::cout << "  - Failed: " << failed_count_ << std::endl;
+    finishPending();
+    sendFallbacks();
+
+    LOG_INFO("[PRODUCER-" << producer_id_ << "] Thread finished");
+    LOG_INFO("[PRODUCER-" << producer_id_ << "] Statistics:");
+    LOG_INFO("  - Successful: " << uploaded_count_);
+    LOG_INFO("  - Failed: " << failed_count_);
+    if (taken_count_ > 0) {
+        LOG_INFO("  - Taken from other producers: " << taken_count_);
+    }
 }
 
 void ProducerThread::stop() {
@@ -0,0 +1,33 @@
+#include "include/rateLimiter.h"
+#include <algorithm>
+#include <thread>
+
+RateLimiter::RateLimiter(uint64_t bytes_per_sec)
+    : bytes_per_sec_(bytes_per_sec),
+      capacity_(bytes_per_sec * BURST_SECONDS),
+      tokens_(capacity_),
+      last_refill_(std::chrono::steady_clock::now()) {}
+
+void RateLimiter::acquire(size_t bytes) {
+    if (bytes_per_sec_ == 0) {
+        return;
+    }
+
+    double deficit;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - last_refill_).count();
+        last_refill_ = now;
+
+        tokens_ = std::min(capacity_, tokens_ + elapsed * bytes_per_sec_);
+        tokens_ -= static_cast<double>(bytes);
+        if (tokens_ >= 0) {
+            return;
+        }
+        // The bucket is in debt: later callers queue up behind this one
+        deficit = -tokens_;
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(deficit / bytes_per_sec_));
+}
@@ -0,0 +1,138 @@
+#include "include/readAheadHasher.h"
+#include "include/inputFile.h"
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <openssl/evp.h>
+
+#ifdef __linux__
+    #include <pthread.h>
+#endif
+
+ReadAheadHasher::ReadAheadHasher(size_t window)
+    : window_(window), file_(nullptr), hashed_(0), released_(0),
+      active_(false), hashing_(false), busy_(false), truncated_(false), stopping_(false),
+      sha_(EVP_MD_CTX_new()), buffer_(HASH_STEP) {
+    thread_ = std::thread([this]() { run(); });
+}
+
+ReadAheadHasher::~ReadAheadHasher() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+    EVP_MD_CTX_free(sha_);
+}
+
+void ReadAheadHasher::start(const InputFile& file, bool hash) {
+    cancel();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    file_ = &file;
+    hashed_ = 0;
+    released_ = 0;
+    truncated_ = false;
+    digest_.clear();
+    EVP_DigestInit_ex(sha_, EVP_sha256(), nullptr);
+    hashing_ = hash;
+    active_ = true;
+
+    // Get the kernel reading the first window right away
+    file.willNeed(0, window_);
+    cv_.notify_all();
+}
+
+void ReadAheadHasher::cancel() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    active_ = false;
+    // The caller may close the file as soon as this returns
+    cv_.wait(lock, [this]() { return !busy_; });
+    file_ = nullptr;
+}
+
+bool ReadAheadHasher::waitFor(size_t end) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (end > released_) {
+        released_ = end;
+        cv_.notify_all();
+    }
+    cv_.wait(lock, [this, end]() { return !active_ || truncated_ || hashed_ >= end; });
+    return hashed_ >= end;
+}
+
+std::string ReadAheadHasher::digest() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!file_ || !hashing_) {
+        return "";
+    }
+    released_ = file_->size();
+    cv_.notify_all();
+    cv_.wait(lock, [this]() {
+        return !active_ || truncated_ || (hashed_ == file_->size() && !busy_);
+    });
+    if (!active_ || truncated_) {
+        return "";
+    }
+
+    if (digest_.empty()) {
+        unsigned char hash[EVP_MAX_MD_SIZE];
+        unsigned int length = 0;
+        EVP_DigestFinal_ex(sha_, hash, &length);
+
+        std::stringstream ss;
+        for (unsigned int i = 0; i < length; i++) {
+            ss << std::hex << std::setw(2) << std::setfill('0')
+               << static_cast<int>(hash[i]);
+        }
+        digest_ = ss.str();
+    }
+    return digest_;
+}
+
+void ReadAheadHasher::run() {
+#ifdef __linux__
+    pthread_setname_np(pthread_self(), "readahead");
+#endif
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        cv_.wait(lock, [this]() {
+            return stopping_ ||
+                   (active_ && !truncated_ && hashed_ < file_->size() &&
+                    hashed_ < released_ + window_);
+        });
+        if (stopping_) {
+            return;
+        }
+
+        const InputFile* file = file_;
+        size_t offset = hashed_;
+        size_t step = std::min(HASH_STEP, file->size() - offset);
+        bool hash = hashing_;
+        busy_ = true;
+        lock.unlock();
+
+        // Keep the kernel's read-ahead a window in front of this thread,
+        // then read the step, which waits for the disk if it is behind.
+        // Without hashing the read only warms the page cache for the sender.
+        if (offset % window_ < step) {
+            file->willNeed(offset + window_, window_);
+        }
+        bool readable = file->read(offset, step, buffer_.data());
+        if (readable && hash) {
+            EVP_DigestUpdate(sha_, buffer_.data(), step);
+        }
+
+        lock.lock();
+        busy_ = false;
+        if (active_ && file_ == file) {
+            if (readable) {
+                hashed_ = offset + step;
+            } else {
+                truncated_ = true;  // shrank since it was opened
+            }
+        }
+        cv_.notify_all();
+    }
+}
@@ -0,0 +1,144 @@
+#include "include/retryJournal.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+static int64_t nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+RetryJournal::~RetryJournal() {
+    if (file_) {
+        fclose(file_);
+    }
+}
+
+bool RetryJournal::open(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    path_ = path;
+
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string type, file_path;
+        Entry entry;
+        fields >> type;
+        if (type == "retry" && fields >> entry.due_ms >> entry.owner &&
+            fields.get() == ' ' && std::getline(fields, file_path) && !file_path.empty()) {
+            entry.path = file_path;
+            entries_[file_path] = {entry, 0};
+        } else if (type == "done" && fields.get() == ' ' && std::getline(fields, file_path)) {
+            entries_.erase(file_path);
+        }
+        // Anything else is a torn line from a crash
+    }
+    in.close();
+
+    compact();
+    return file_ != nullptr;
+}
+
+std::vector<RetryJournal::Entry> RetryJournal::pending() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Entry> entries;
+    for (const auto& [path, state] : entries_) {
+        entries.push_back(state.entry);
+    }
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry& a, const Entry& b) { return a.due_ms < b.due_ms; });
+    return entries;
+}
+
+bool RetryJournal::schedule(const std::string& path, int owner, UploadOutcome outcome,
+                            int& attempt, std::chrono::milliseconds& delay) {
+    const Policy& policy = outcome == UploadOutcome::Capacity ? CAPACITY_POLICY : TRANSIENT_POLICY;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    State& state = entries_[path];
+    state.entry.path = path;
+    state.entry.owner = owner;
+    attempt = ++state.attempts;
+
+    // Equal jitter: half the backoff is fixed, the other half random, so
+    // producers that failed together do not all come back together
+    auto backoff = policy.base * (1LL << std::min(attempt - 1, 20));
+    backoff = std::min<std::chrono::milliseconds>(backoff, policy.cap);
+    std::uniform_int_distribution<int64_t> jitter(0, backoff.count() / 2);
+    delay = std::chrono::milliseconds(backoff.count() - backoff.count() / 2 + jitter(rng_));
+
+    bool retry = attempt <= policy.max_attempts;
+    // Once given up on, the file is due again at the next start
+    state.entry.due_ms = retry ? nowMs() + delay.count() : 0;
+    append("retry " + std::to_string(state.entry.due_ms) + " " +
+           std::to_string(owner) + " " + path);
+    return retry;
+}
+
+void RetryJournal::remove(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (entries_.erase(path) == 0) {
+        return;
+    }
+    append("done " + path);
+
+    if (records_ >= COMPACT_MIN_RECORDS && records_ > 4 * entries_.size()) {
+        compact();
+    }
+}
+
+size_t RetryJournal::size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+void RetryJournal::append(const std::string& line) {
+    if (!file_) {
+        return;
+    }
+    // Flushed per line so a killed client still retries the file next time
+    fprintf(file_, "%s\n", line.c_str());
+    fflush(file_);
+    records_++;
+}
+
+void RetryJournal::compact() {
+    if (path_.empty()) {
+        return;
+    }
+    if (file_) {
+        fclose(file_);
+        file_ = nullptr;
+    }
+
+    // Write the live entries next to the journal and swap it in, so a
+    // crash leaves either the old or the new version
+    std::string temp_path = path_ + ".tmp";
+    FILE* temp = fopen(temp_path.c_str(), "w");
+    if (temp) {
+        for (const auto& [path, state] : entries_) {
+            fprintf(temp, "retry %lld %d %s\n", static_cast<long long>(state.entry.due_ms),
+                    state.entry.owner, path.c_str());
+        }
+        bool written = fflush(temp) == 0;
+        fclose(temp);
+        std::error_code ec;
+        if (written) {
+            fs::rename(temp_path, path_, ec);  // replaces the old journal, also on Windows
+            if (!ec) {
+                records_ = entries_.size();
+            }
+        }
+    }
+
+    file_ = fopen(path_.c_str(), "a");
+    if (!file_) {
+        std::cerr << "[PRODUCER] Cannot write retry journal " << path_ 
+                  << ", failed uploads will only be retried until exit" << std::endl;
+    }
+}
@@ -2,9 +2,16 @@
 #include <memory>
 #include <string>
 #include <csignal>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include <vector>
 #include <grpcpp/grpcpp.h>
 #include "include/consumerServer.h"
+#include "include/uploadGateway.h"
 #include "include/webServer.h"
+#include "include/logger.h"
+#include "include/commandLine.h"
 
 using grpc::Server;
 using grpc::ServerBuilder;
@@ -12,36 +19,119 @@ using grpc::ServerBuilder;
 std::unique_ptr<Server> grpc_server_instance;
 std::unique_ptr<ConsumerServer> consumer_service;
 std::unique_ptr<WebServer> web_server;
+std::unique_ptr<UploadGateway> gateway_service;  // gateway mode only
 
+volatile std::sig_atomic_t shutdown_requested = 0;
+
+// The shutdown itself runs on its own thread (see main); a second Ctrl+C
+// gives up on draining and exits at once
 void signalHandler(int signum) {
-    std::cout << "\n\nShutting down gracefully..." << std::endl;
-    
+    if (shutdown_requested) {
+        std::_Exit(1);
+    }
+    shutdown_requested = 1;
+}
+
+// Refuses new uploads, lets in-flight calls and the queue finish until
+// the deadline, then spools whatever is still queued to disk
+void shutdownServer(int drain_seconds) {
+    Logger::instance().flush();
+    std::cout << "\n\nShutting down gracefully (up to " << drain_seconds
+              << "s to drain, Ctrl+C again to quit now)..." << std::endl;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(drain_seconds);
+
     if (consumer_service) {
-        consumer_service->stop();
+        consumer_service->beginShutdown();
+    }
+    grpc_server_instance->Shutdown(std::chrono::system_clock::now() +
+                                   std::chrono::seconds(drain_seconds));
+    if (consumer_service) {
+        consumer_service->stop(deadline);
+    }
+    if (gateway_service) {
+        gateway_service->stop();
     }
-    
     if (web_server) {
         web_server->stop();
     }
-    
-    if (grpc_server_instance) {
-        grpc_server_instance->Shutdown();
-    }
-    
-    exit(0);
+}
+
+// Serves until a signal, then shuts down on a thread of its own
+void waitForShutdown(int drain_seconds) {
+    std::thread shutdown_thread([drain_seconds]() {
+        while (!shutdown_requested) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        shutdownServer(drain_seconds);
+    });
+
+    // Wait for server shutdown
+    grpc_server_instance->Wait();
+    shutdown_thread.join();
+}
+
+int runGateway(const std::vector<std::string>& backends, int grpc_port, int drain_seconds) {
+    std::cout << "\n╔════════════════════════════════════════════════╗" << std::endl;
+    std::cout << "║  Media Upload Service - Upload Gateway        ║" << std::endl;
+    std::cout << "╚════════════════════════════════════════════════╝" << std::endl;
+    std::cout << "\n📊 Configuration:" << std::endl;
+    std::cout << "  gRPC port:        " << grpc_port << std::endl;
+    std::cout << "  Backends:         " << backends.size() << std::endl;
+
+    gateway_service = std::make_unique<UploadGateway>(backends);
+    gateway_service->start();
+
+    std::string server_address = "0.0.0.0:" + std::to_string(grpc_port);
+    ServerBuilder builder;
+    builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
+    builder.SetMaxReceiveMessageSize(ConsumerServer::MAX_MESSAGE_SIZE);
+    builder.RegisterService(gateway_service.get());
+
+    grpc_server_instance = builder.BuildAndStart();
+    std::cout << "🚀 Gateway listening on " << server_address << std::endl;
+    std::cout << "\n✅ Gateway is ready to accept uploads!" << std::endl;
+    std::cout << "   Press Ctrl+C to stop the gateway\n" << std::endl;
+
+    waitForShutdown(drain_seconds);
+    return 0;
 }
 
 void printUsage(const char* program_name) {
-    std::cout << "Usage: " << program_name << " -c <consumers> -q <queue_size> [-p <port>] [-w <web_port>] [-o <output_dir>]\n";
+    std::cout << "Usage: " << program_name << " -c <consumers> -q <queue_size> [-p <port>] [-w <web_port>] [-o <output_dir>] [-e <events_per_sec>] [-L <level>] [-R <count>] [-t <rate>] [-d <seconds>] [-m <bytes>] [-P <kind>=<cpus>] [-N]\n";
+    std::cout << "       " << program_name << " -b <backends> [-p <port>] [-d <seconds>] [-L <level>] [-R <count>]\n";
     std::cout << "\nOptions:\n";
     std::cout << "  -c <consumers>    Number of consumer threads (default: 4)\n";
     std::cout << "  -q <queue_size>   Maximum queue size/capacity (default: 10)\n";
     std::cout << "  -p <port>         gRPC server port (default: 50051)\n";
     std::cout << "  -w <web_port>     Web GUI port (default: 8080)\n";
     std::cout << "  -o <output_dir>   Output directory for videos (default: ./uploaded_videos)\n";
+    std::cout << "  -e <events/sec>   Max live dashboard updates per second (default: 4)\n";
+    std::cout << "  -L <level>        Log level: debug, info, warn, error or off (default: info);\n";
+    std::cout << "                    per-upload progress is logged at debug\n";
+    std::cout << "  -R <count>        Max messages per second from one log statement, 0 = no\n";
+    std::cout << "                    limit (default: 100)\n";
+    std::cout << "  -t <rate>         Share of uploads to trace when the producer sent no trace\n";
+    std::cout << "                    id, 0-1 (default: 0.01); traces at /api/trace\n";
+    std::cout << "  -d <seconds>      On Ctrl+C or SIGTERM, how long to keep processing queued\n";
+    std::cout << "                    uploads before spooling the rest to disk (default: 5)\n";
+    std::cout << "  -m <bytes>        Memory for uploads being received, all together; K, M\n";
+    std::cout << "                    and G suffixes, 0 = unlimited (default: 1G). Uploads over\n";
+    std::cout << "                    it wait, and their producers are slowed down\n";
+    std::cout << "  -P <kind>=<cpus>  Pin consumer, grpc or web threads to a CPU list such\n";
+    std::cout << "                    as 0-3,8; may be repeated (default: unpinned)\n";
+    std::cout << "  -N                NUMA dispatch: consumers and upload RPC threads are spread\n";
+    std::cout << "                    over the NUMA nodes, and each upload is processed on the\n";
+    std::cout << "                    node whose memory it was received into\n";
+    std::cout << "  -b <backends>     Gateway mode: store nothing, pass each upload on to the\n";
+    std::cout << "                    comma-separated consumer server with the most free queue\n";
+    std::cout << "                    slots; statistics are summed over them\n";
     std::cout << "\nExample:\n";
     std::cout << "  " << program_name << " -c 4 -q 10\n";
     std::cout << "  " << program_name << " -c 8 -q 20 -p 50051 -w 8080\n";
+    std::cout << "  " << program_name << " -c 4 -q 10 -L debug\n";
+    std::cout << "  " << program_name << " -c 8 -q 20 -P consumer=2-7 -P grpc=0-1 -P web=0\n";
+    std::cout << "  " << program_name << " -c 8 -q 20 -N\n";
+    std::cout << "  " << program_name << " -b host1:50051,host2:50051 -p 50050\n";
 }
 
 int main(int argc, char** argv) {
@@ -51,6 +141,12 @@ int main(int argc, char** argv) {
     int grpc_port = 50051;
     int web_port = 8080;
     std::string output_dir = "./uploaded_videos";
+    int max_events_per_sec = 4;
+    double trace_rate = Tracer::DEFAULT_SAMPLE_RATE;
+    int drain_seconds = 5;  // inside docker stop's 10s grace period
+    size_t memory_limit = MemoryBudget::DEFAULT_LIMIT;
+    std::vector<std::string> backends;
+    ThreadPlacement placement;
 
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
@@ -66,6 +162,59 @@ int main(int argc, char** argv) {
             web_port = std::stoi(argv[++i]);
         } else if (arg == "-o" && i + 1 < argc) {
             output_dir = argv[++i];
+        } else if (arg == "-e" && i + 1 < argc) {
+            max_events_per_sec = std::stoi(argv[++i]);
+        } else if (arg == "-L" && i + 1 < argc) {
+            LogLevel level;
+            if (!Logger::parseLevel(argv[++i], level)) {
+                std::cerr << "Error: Unknown log level: " << argv[i]
+                          << " (expected debug, info, warn, error or off)" << std::endl;
+                return 1;
+            }
+            Logger::setLevel(level);
+        } else if (arg == "-R" && i + 1 < argc) {
+            Logger::setRateLimit(std::stoi(argv[++i]));
+        } else if (arg == "-t" && i + 1 < argc) {
+            trace_rate = std::stod(argv[++i]);
+        } else if (arg == "-d" && i + 1 < argc) {
+            drain_seconds = std::stoi(argv[++i]);
+        } else if (arg == "-b" && i + 1 < argc) {
+            backends = splitAddresses(argv[++i]);
+            if (backends.empty()) {
+                std::cerr << "Error: No backend addresses given" << std::endl;
+                return 1;
+            }
+        } else if (arg == "-m" && i + 1 < argc) {
+            uint64_t limit;
+            if (!parseQuantity(argv[++i], 1024, limit)) {
+                std::cerr << "Error: Invalid memory limit: " << argv[i] << std::endl;
+                return 1;
+            }
+            memory_limit = static_cast<size_t>(limit);
+        } else if (arg == "-P" && i + 1 < argc) {
+            std::string spec = argv[++i];
+            size_t equals = spec.find('=');
+            std::string threads = spec.substr(0, equals);
+            std::vector<int> cpus;
+            if (equals == std::string::npos ||
+                !CpuAffinity::parseCpuList(spec.substr(equals + 1), cpus)) {
+                std::cerr << "Error: Invalid thread placement: " << spec
+                          << " (expected consumer, grpc or web=<cpus>)" << std::endl;
+                return 1;
+            }
+            if (threads == "consumer") {
+                placement.consumer_cpus = cpus;
+            } else if (threads == "grpc") {
+                placement.grpc_cpus = cpus;
+            } else if (threads == "web") {
+                placement.web_cpus = cpus;
+            } else {
+                std::cerr << "Error: Unknown thread kind: " << threads
+                          << " (expected consumer, grpc or web)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "-N") {
+            placement.numa = true;
         } else if (arg == "-h" || arg == "--help") {
             printUsage(argv[0]);
             return 0;
@@ -87,9 +236,33 @@ int main(int argc, char** argv) {
         return 1;
     }
 
+    if (max_events_per_sec < 1 || max_events_per_sec > 100) {
+        std::cerr << "Error: Event rate must be between 1 and 100 per second" << std::endl;
+        return 1;
+    }
+
+    if (trace_rate < 0 || trace_rate > 1) {
+        std::cerr << "Error: Trace sample rate must be between 0 and 1" << std::endl;
+        return 1;
+    }
+
+    if (drain_seconds < 0 || drain_seconds > 3600) {
+        std::cerr << "Error: Drain timeout must be between 0 and 3600 seconds" << std::endl;
+        return 1;
+    }
+
     // Set up signal handler
     signal(SIGINT, signalHandler);
     signal(SIGTERM, signalHandler);
+#ifndef _WIN32
+    // sendfile() has no MSG_NOSIGNAL; a video download the client cuts
+    // short must fail with EPIPE, not kill the server
+    signal(SIGPIPE, SIG_IGN);
+#endif
+
+    if (!backends.empty()) {
+        return runGateway(backends, grpc_port, drain_seconds);
+    }
 
     std::cout << "\n╔════════════════════════════════════════════════╗" << std::endl;
     std::cout << "║  Media Upload Service - Consumer Server       ║" << std::endl;
@@ -100,18 +273,39 @@ int main(int argc, char** argv) {
     std::cout << "  gRPC port:        " << grpc_port << std::endl;
     std::cout << "  Web GUI port:     " << web_port << std::endl;
     std::cout << "  Output directory: " << output_dir << std::endl;
+    std::cout << "  Receive memory:   "
+              << (memory_limit ? std::to_string(memory_limit / (1024 * 1024)) + " MB"
+                               : std::string("unlimited")) << std::endl;
+    auto cpuList = [](const std::vector<int>& cpus) {
+        return cpus.empty() ? std::string("any") : CpuAffinity::formatCpuList(cpus);
+    };
+    std::cout << "  Thread CPUs:      consumer " << cpuList(placement.consumer_cpus)
+              << ", grpc " << cpuList(placement.grpc_cpus)
+              << ", web " << cpuList(placement.web_cpus) << std::endl;
+    if (placement.numa) {
+        int nodes = CpuAffinity::nodeCount();
+        std::cout << "  NUMA dispatch:    "
+                  << (nodes > 1 ? "on, " + std::to_string(nodes) + " nodes"
+                                : std::string("off, only one node")) << std::endl;
+    }
     std::cout << "\n✨ Features enabled:" << std::endl;
     std::cout << "  ✓ Queue management (leaky bucket)" << std::endl;
     std::cout << "  ✓ Duplicate detection (SHA-256 hashing)" << std::endl;
     std::cout << "  ✓ Queue status API for producers" << std::endl;
     std::cout << "  ✓ Web-based GUI with video preview" << std::endl;
-    std::cout << "  ✓ Real-time statistics" << std::endl;
+    std::cout << "  ✓ Real-time statistics (live event stream, max "
+              << max_events_per_sec << " updates/s)" << std::endl;
+    std::cout << "  ✓ Upload tracing (" << trace_rate * 100 << "% sampled, plus producer-traced"
+              << " uploads; /api/trace)" << std::endl;
     std::cout << std::endl;
 
     // Create consumer service
     consumer_service = std::make_unique<ConsumerServer>(
         num_consumers, max_queue_size, output_dir
     );
+    consumer_service->tracer().setSampleRate(trace_rate);
+    consumer_service->setMemoryLimit(memory_limit);
+    consumer_service->setThreadPlacement(placement);
 
     // Start consumer workers
     consumer_service->start();
@@ -120,21 +314,22 @@ int main(int argc, char** argv) {
     std::string server_address = "0.0.0.0:" + std::to_string(grpc_port);
     ServerBuilder builder;
     builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
+    builder.SetMaxReceiveMessageSize(ConsumerServer::MAX_MESSAGE_SIZE);
     builder.RegisterService(consumer_service.get());
     
     grpc_server_instance = builder.BuildAndStart();
     std::cout << "🚀 gRPC Server listening on " << server_address << std::endl;
 
     // Start web server for GUI
-    web_server = std::make_unique<WebServer>(web_port, consumer_service.get(), "./web");
+    web_server = std::make_unique<WebServer>(web_port, consumer_service.get(), "./web",
+                                             max_events_per_sec);
+    web_server->setCpus(placement.web_cpus);
     web_server->start();
     std::cout << "🌐 Web GUI available at http://localhost:" << web_port << std::endl;
 
     std::cout << "\n✅ Server is ready to accept uploads!" << std::endl;
     std::cout << "   Press Ctrl+C to stop the server\n" << std::endl;
 
-    // Wait for server shutdown
-    grpc_server_instance->Wait();
-
+    waitForShutdown(drain_seconds);
     return 0;
 }
@@ -0,0 +1,335 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <random>
+#include <filesystem>
+#include <thread>
+#include <benchmark/benchmark.h>
+#include "include/consumerServer.h"
+#include "include/webServer.h"
+#include "include/cpuAffinity.h"
+
+// Microbenchmarks for the consumer_server hot paths. Everything runs
+// in-process against the real ConsumerServer and WebServer code, with
+// no sockets, so the numbers move only when these paths change.
+//
+//   ./server_microbench --benchmark_filter=Hash
+//   ./server_microbench --benchmark_format=json > before.json
+
+namespace fs = std::filesystem;
+
+struct ConsumerServerBenchAccess {
+    static void appendChunk(std::vector<char>& video_data, const std::string& chunk) {
+        ConsumerServer::appendChunk(video_data, chunk);
+    }
+    static std::string calculateHash(const std::vector<char>& data) {
+        return ConsumerServer::calculateHash(data);
+    }
+    static std::string hexEncode(const unsigned char* data, size_t length) {
+        return ConsumerServer::hexEncode(data, length);
+    }
+    static bool enqueue(ConsumerServer& server, const std::vector<char>& data) {
+        UploadResponse response;
+        server.acceptUpload("BENCH", "bench.mp4", 1, data.size(), "", 0, 0, data, &response);
+        return response.success();
+    }
+    static bool dequeue(ConsumerServer& server, UploadTask& task, int node = -1) {
+        return server.popTask(task, node);
+    }
+    // Pretends the machine has `nodes` NUMA nodes, with dispatch by node on or off
+    static void setNumaDispatch(ConsumerServer& server, bool dispatch, int nodes) {
+        std::lock_guard<std::mutex> lock(server.queue_mutex_);
+        server.numa_dispatch_ = dispatch;
+        server.idle_workers_.assign(nodes, 0);
+    }
+    // The queueing half of acceptUpload, for an upload received on `node`
+    static void enqueueOnNode(ConsumerServer& server, int node) {
+        {
+            std::lock_guard<std::mutex> lock(server.queue_mutex_);
+            UploadTask task;
+            task.video_id = "BENCH";
+            task.numa_node = node;
+            server.upload_queue_.push_back(std::move(task));
+        }
+        if (server.numa_dispatch_) {
+            server.queue_cv_.notify_all();
+        } else {
+            server.queue_cv_.notify_one();
+        }
+    }
+    static void addHash(ConsumerServer& server, const std::string& hash) {
+        server.uploaded_hashes_.insert(hash);
+    }
+    static bool isDuplicate(ConsumerServer& server, const std::string& hash) {
+        std::lock_guard<std::mutex> lock(server.hash_mutex_);
+        return server.uploaded_hashes_.find(hash) != server.uploaded_hashes_.end();
+    }
+    static void addMetadata(ConsumerServer& server, VideoMetadata meta) {
+        std::lock_guard<std::mutex> lock(server.metadata_mutex_);
+        server.appendMetadata(std::move(meta));
+    }
+};
+
+struct WebServerBenchAccess {
+    static size_t videosJson(WebServer& web_server) {
+        uint64_t version = 0;
+        size_t bytes = 0;
+        for (const auto& segment : web_server.getVideosJson(version)) {
+            bytes += segment->size();
+        }
+        return bytes;
+    }
+};
+
+static std::string benchDir() {
+    return (fs::temp_directory_path() / "server_microbench").string();
+}
+
+static std::vector<char> randomBytes(size_t size, uint32_t seed = 1) {
+    std::vector<char> data(size);
+    std::mt19937 rng(seed);
+    for (auto& byte : data) {
+        byte = static_cast<char>(rng());
+    }
+    return data;
+}
+
+static std::string fakeHash(uint64_t i) {
+    unsigned char digest[32] = {};
+    for (int b = 0; b < 8; b++) {
+        digest[b] = static_cast<unsigned char>(i >> (8 * b));
+        digest[31 - b] = static_cast<unsigned char>((i * 0x9E3779B97F4A7C15ull) >> (8 * b));
+    }
+    return ConsumerServerBenchAccess::hexEncode(digest, sizeof(digest));
+}
+
+static VideoMetadata fakeMetadata(uint64_t i) {
+    VideoMetadata meta;
+    meta.video_id = "VID_" + std::to_string(i % 8 + 1) + "_1792390000000_" + std::to_string(i);
+    meta.filename = "camera_" + std::to_string(i) + ".mp4";
+    meta.file_path = "./uploaded_videos/" + meta.video_id + "_" + meta.filename;
+    meta.file_hash = fakeHash(i);
+    meta.producer_id = static_cast<int>(i % 8) + 1;
+    meta.consumer_id = static_cast<int>(i % 4) + 1;
+    meta.file_size = 1000000 + i;
+    meta.upload_time = std::chrono::system_clock::now();
+    meta.is_duplicate = i % 50 == 0;
+    return meta;
+}
+
+// UploadVideo/UploadVideoFrames: collecting a 16 MB upload chunk by chunk
+static void BM_AppendChunks(benchmark::State& state) {
+    const size_t total = 16 * 1024 * 1024;
+    const std::string chunk(static_cast<size_t>(state.range(0)), 'x');
+    for (auto _ : state) {
+        std::vector<char> video_data;
+        for (size_t received = 0; received < total; received += chunk.size()) {
+            ConsumerServerBenchAccess::appendChunk(video_data, chunk);
+        }
+        benchmark::DoNotOptimize(video_data.data());
+    }
+    state.SetBytesProcessed(state.iterations() * total);
+}
+BENCHMARK(BM_AppendChunks)->Arg(16 << 10)->Arg(64 << 10)->Arg(1 << 20)->Unit(benchmark::kMillisecond);
+
+static void BM_CalculateHash(benchmark::State& state) {
+    auto data = randomBytes(static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ConsumerServerBenchAccess::calculateHash(data));
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_CalculateHash)->Arg(1 << 10)->Arg(64 << 10)->Arg(1 << 20)->Arg(16 << 20);
+
+// A consumer hashing an upload received on its own NUMA node (0) and on
+// another (1): the buffer is first touched by a thread on the receiving
+// node, as in UploadVideoFrames, so its pages live there. 64 MB keeps
+// the reads out of the caches. This is the memory cost -N saves; the
+// cost of dispatching by node is BM_NumaDispatch.
+static void BM_RemoteNodeHash(benchmark::State& state) {
+    if (CpuAffinity::nodeCount() < 2) {
+        state.SkipWithError("needs at least two NUMA nodes");
+        return;
+    }
+    int consumer_node = 0;
+    int receive_node = state.range(0) ? 1 : 0;
+    std::vector<char> data;
+    std::thread receiver([&data, receive_node]() {
+        CpuAffinity::pinCurrentThread(CpuAffinity::nodeCpus(receive_node));
+        data = randomBytes(64 << 20);
+    });
+    receiver.join();
+
+    std::vector<int> previous = CpuAffinity::currentCpus();
+    CpuAffinity::pinCurrentThread(CpuAffinity::nodeCpus(consumer_node));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ConsumerServerBenchAccess::calculateHash(data));
+    }
+    CpuAffinity::pinCurrentThread(previous);
+    state.SetBytesProcessed(state.iterations() * data.size());
+    state.SetLabel(receive_node == consumer_node ? "local" : "remote");
+}
+BENCHMARK(BM_RemoteNodeHash)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+// The hex step of calculateHash on its own
+static void BM_HexEncode(benchmark::State& state) {
+    unsigned char digest[32];
+    for (int i = 0; i < 32; i++) {
+        digest[i] = static_cast<unsigned char>(i * 37);
+    }
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ConsumerServerBenchAccess::hexEncode(digest, sizeof(digest)));
+    }
+}
+BENCHMARK(BM_HexEncode);
+
+// acceptUpload into upload_queue_ and the consumer worker's pop, with
+// every thread doing both; 1 KB payloads keep hashing out of the way.
+// Created in main, before any benchmark thread runs.
+static std::unique_ptr<ConsumerServer> queue_server;
+
+static void BM_QueueHandoff(benchmark::State& state) {
+    auto data = randomBytes(1024, static_cast<uint32_t>(state.thread_index()) + 1);
+    UploadTask task;
+
+    for (auto _ : state) {
+        ConsumerServerBenchAccess::enqueue(*queue_server, data);
+        ConsumerServerBenchAccess::dequeue(*queue_server, task);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_QueueHandoff)->ThreadRange(1, 8)->UseRealTime();
+
+// The queue handoff with consumer workers on two nodes, FIFO (0) and with
+// -N dispatch by node (1): popTask's findTask scan, the idle-worker
+// counts and notify_all in place of notify_one. Threads alternate
+// between the nodes and each queues an upload of its own node before
+// taking one; range(1) uploads wait in the queue throughout, half from
+// each node. Only the bookkeeping is simulated, so this runs on a
+// single-node machine too.
+static std::unique_ptr<ConsumerServer> dispatch_server;
+
+static void BM_NumaDispatch(benchmark::State& state) {
+    if (state.thread_index() == 0) {
+        dispatch_server = std::make_unique<ConsumerServer>(0, 1 << 20, benchDir());
+        ConsumerServerBenchAccess::setNumaDispatch(*dispatch_server, state.range(0) != 0, 2);
+        for (int64_t i = 0; i < state.range(1); i++) {
+            ConsumerServerBenchAccess::enqueueOnNode(*dispatch_server, static_cast<int>(i % 2));
+        }
+    }
+    int node = state.thread_index() % 2;
+    UploadTask task;
+
+    for (auto _ : state) {
+        ConsumerServerBenchAccess::enqueueOnNode(*dispatch_server, node);
+        ConsumerServerBenchAccess::dequeue(*dispatch_server, task, node);
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(state.range(0) ? "by node" : "fifo");
+
+    if (state.thread_index() == 0) {
+        dispatch_server.reset();
+    }
+}
+BENCHMARK(BM_NumaDispatch)->ArgsProduct({{0, 1}, {0, 64}})->ThreadRange(1, 8)->UseRealTime();
+
+// The duplicate check in acceptUpload, against N known hashes; half the
+// lookups hit
+static std::unique_ptr<ConsumerServer> hash_server;
+static uint64_t hash_entries = 0;
+
+static void BM_DuplicateLookup(benchmark::State& state) {
+    const uint64_t known = static_cast<uint64_t>(state.range(0));
+    if (hash_entries != known) {
+        hash_server.reset();
+        hash_server = std::make_unique<ConsumerServer>(0, 1, benchDir());
+        for (uint64_t i = 0; i < known; i++) {
+            ConsumerServerBenchAccess::addHash(*hash_server, fakeHash(i * 2));
+        }
+        hash_entries = known;
+    }
+    ConsumerServer& server = *hash_server;
+
+    std::vector<std::string> probes;
+    for (uint64_t i = 0; i < 1024; i++) {
+        probes.push_back(fakeHash((i * 7919) % known + i % 2));
+    }
+
+    size_t next = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ConsumerServerBenchAccess::isDuplicate(server, probes[next]));
+        next = (next + 1) % probes.size();
+    }
+}
+BENCHMARK(BM_DuplicateLookup)->RangeMultiplier(10)->Range(1000, 1000000);
+
+// /api/videos: serializing N entries from scratch, and adding one more to
+// an N-entry list that is already serialized
+static std::unique_ptr<ConsumerServer> metadata_server;
+static int64_t metadata_entries = 0;
+
+static ConsumerServer& serverWithMetadata(int64_t entries) {
+    if (metadata_entries != entries) {
+        metadata_server.reset();
+        metadata_server = std::make_unique<ConsumerServer>(0, 1, benchDir());
+        for (int64_t i = 0; i < entries; i++) {
+            ConsumerServerBenchAccess::addMetadata(*metadata_server, fakeMetadata(i));
+        }
+        metadata_entries = entries;
+    }
+    return *metadata_server;
+}
+
+static void BM_VideosJsonFull(benchmark::State& state) {
+    ConsumerServer& server = serverWithMetadata(state.range(0));
+    size_t bytes = 0;
+    for (auto _ : state) {
+        WebServer web_server(0, &server, benchDir());
+        bytes = WebServerBenchAccess::videosJson(web_server);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * bytes);
+}
+BENCHMARK(BM_VideosJsonFull)->RangeMultiplier(10)->Range(1000, 1000000)
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_VideosJsonAppend(benchmark::State& state) {
+    ConsumerServer& server = serverWithMetadata(state.range(0));
+    WebServer web_server(0, &server, benchDir());
+    WebServerBenchAccess::videosJson(web_server);
+
+    uint64_t next = static_cast<uint64_t>(state.range(0));
+    for (auto _ : state) {
+        state.PauseTiming();
+        ConsumerServerBenchAccess::addMetadata(server, fakeMetadata(next++));
+        state.ResumeTiming();
+        benchmark::DoNotOptimize(WebServerBenchAccess::videosJson(web_server));
+    }
+    metadata_entries = -1;  // the list grew; rebuild it for the next size
+}
+BENCHMARK(BM_VideosJsonAppend)->RangeMultiplier(10)->Range(1000, 1000000);
+
+int main(int argc, char** argv) {
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+
+    // The server logs every upload; keep that out of the results and the timings
+    std::ostream results(std::cout.rdbuf());
+    std::unique_ptr<benchmark::BenchmarkReporter> reporter(benchmark::CreateDefaultDisplayReporter());
+    reporter->SetOutputStream(&results);
+    reporter->SetErrorStream(&std::cerr);
+    std::cout.rdbuf(nullptr);
+
+    queue_server = std::make_unique<ConsumerServer>(0, 1 << 20, benchDir());
+    benchmark::RunSpecifiedBenchmarks(reporter.get());
+    benchmark::Shutdown();
+
+    queue_server.reset();
+    hash_server.reset();
+    metadata_server.reset();
+    fs::remove_all(benchDir());
+    return 0;
+}
@@ -0,0 +1,114 @@
+#include "include/shardRouter.h"
+#include <algorithm>
+#include <openssl/sha.h>
+
+ShardRouter::ShardRouter(const std::vector<std::string>& addresses, int channels_per_shard) {
+    for (const auto& address : addresses) {
+        addShard(address, std::make_shared<ChannelPool>(address, channels_per_shard));
+    }
+}
+
+ShardRouter::ShardRouter(const std::string& name, std::shared_ptr<ChannelPool> channels) {
+    addShard(name, std::move(channels));
+}
+
+void ShardRouter::addShard(const std::string& address, std::shared_ptr<ChannelPool> channels) {
+    int index = static_cast<int>(shards_.size());
+    auto shard = std::make_unique<Shard>();
+    shard->address = address;
+    shard->channels = std::move(channels);
+    shard->credits = std::make_unique<UploadCredits>(shard->channels->stub(0));
+    shards_.push_back(std::move(shard));
+
+    // Points depend only on the address, so every client builds the same
+    // ring whatever order the addresses were given in
+    for (int i = 0; i < VIRTUAL_NODES; i++) {
+        ring_.emplace_back(ringPosition(address + "#" + std::to_string(i)), index);
+    }
+    std::sort(ring_.begin(), ring_.end());
+}
+
+uint64_t ShardRouter::ringPosition(const std::string& text) {
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    SHA256(reinterpret_cast<const unsigned char*>(text.data()), text.size(), digest);
+    uint64_t position = 0;
+    for (int i = 0; i < 8; i++) {
+        position = (position << 8) | digest[i];
+    }
+    return position;
+}
+
+int64_t ShardRouter::nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool ShardRouter::isHealthy(const Shard& shard, int64_t now_ms) const {
+    return shard.down_until_ms.load() <= now_ms;
+}
+
+int ShardRouter::pick(const std::string& content_hash, bool& failover) {
+    failover = false;
+    if (shards_.size() == 1) {
+        return 0;
+    }
+
+    // Walk clockwise from the file's point; the first shard met is its
+    // own, the ones after it are the replicas in order
+    uint64_t position = ringPosition(content_hash);
+    auto start = std::lower_bound(ring_.begin(), ring_.end(),
+                                  std::make_pair(position, 0));
+    size_t first = static_cast<size_t>(start - ring_.begin()) % ring_.size();
+    int own = ring_[first].second;
+
+    int64_t now_ms = nowMs();
+    std::vector<bool> tried(shards_.size(), false);
+    for (size_t step = 0; step < ring_.size(); step++) {
+        int shard = ring_[(first + step) % ring_.size()].second;
+        if (tried[shard]) {
+            continue;
+        }
+        tried[shard] = true;
+        if (isHealthy(*shards_[shard], now_ms)) {
+            failover = shard != own;
+            return shard;
+        }
+    }
+    return own;  // all down: keep trying the file's own shard
+}
+
+void ShardRouter::recordResult(int shard, bool reachable, bool delivered, uint64_t bytes,
+                               bool failover) {
+    Shard& target = *shards_[shard];
+    if (!reachable) {
+        target.failures++;
+        if (shards_.size() > 1) {
+            target.down_until_ms = nowMs() + RETRY_AFTER_MS;
+        }
+        return;
+    }
+    target.down_until_ms = 0;
+    if (delivered) {
+        target.uploads++;
+        target.bytes += bytes;
+        if (failover) {
+            target.failovers++;
+        }
+    }
+}
+
+std::vector<ShardRouter::ShardStats> ShardRouter::getStatistics() const {
+    int64_t now_ms = nowMs();
+    std::vector<ShardStats> stats;
+    for (const auto& shard : shards_) {
+        stats.push_back({shard->address, isHealthy(*shard, now_ms), shard->uploads,
+                         shard->bytes, shard->failures, shard->failovers});
+    }
+    return stats;
+}
+
+void ShardRouter::stop() {
+    for (auto& shard : shards_) {
+        shard->credits->stop();
+    }
+}
@@ -0,0 +1,244 @@
+#include "include/staticAssetCache.h"
+#include "include/logger.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <filesystem>
+#include <chrono>
+#include <zlib.h>
+#include <openssl/sha.h>
+
+#ifdef HAVE_BROTLI
+    #include <brotli/encode.h>
+#endif
+
+#ifdef __linux__
+    #include <unistd.h>
+    #include <poll.h>
+    #include <sys/inotify.h>
+#endif
+
+namespace fs = std::filesystem;
+
+static bool isCompressible(const std::string& content_type) {
+    return content_type.rfind("text/", 0) == 0 ||
+           content_type == "application/javascript" ||
+           content_type == "application/json" ||
+           content_type == "image/svg+xml";
+}
+
+static std::string gzipCompress(const std::string& input) {
+    z_stream stream{};
+    // windowBits 15 + 16 selects the gzip wrapper instead of raw zlib
+    if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        return "";
+    }
+
+    std::string output(deflateBound(&stream, input.size()), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    stream.avail_in = static_cast<uInt>(input.size());
+    stream.next_out = reinterpret_cast<Bytef*>(output.data());
+    stream.avail_out = static_cast<uInt>(output.size());
+
+    int result = deflate(&stream, Z_FINISH);
+    output.resize(stream.total_out);
+    deflateEnd(&stream);
+
+    return result == Z_STREAM_END ? output : "";
+}
+
+static std::string brotliCompress(const std::string& input) {
+#ifdef HAVE_BROTLI
+    size_t encoded_size = BrotliEncoderMaxCompressedSize(input.size());
+    std::string output(encoded_size, '\0');
+    if (!BrotliEncoderCompress(BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW,
+                               BROTLI_MODE_TEXT, input.size(),
+                               reinterpret_cast<const uint8_t*>(input.data()),
+                               &encoded_size,
+                               reinterpret_cast<uint8_t*>(output.data()))) {
+        return "";
+    }
+    output.resize(encoded_size);
+    return output;
+#else
+    (void)input;
+    return "";
+#endif
+}
+
+static std::string contentHash(const std::string& data) {
+    unsigned char hash[SHA256_DIGEST_LENGTH];
+    SHA256(reinterpret_cast<const unsigned char*>(data.data()), data.size(), hash);
+
+    // 128 bits is plenty to tell two versions of an asset apart
+    std::stringstream ss;
+    for (int i = 0; i < 16; i++) {
+        ss << std::hex << std::setw(2) << std::setfill('0')
+           << static_cast<int>(hash[i]);
+    }
+    return ss.str();
+}
+
+StaticAssetCache::StaticAssetCache(const std::string& web_root)
+    : web_root_(web_root),
+      assets_(std::make_shared<AssetMap>()),
+      running_(false),
+      inotify_fd_(-1) {}
+
+StaticAssetCache::~StaticAssetCache() {
+    stop();
+}
+
+std::string StaticAssetCache::contentTypeFor(const std::string& path) {
+    if (path.ends_with(".css")) return "text/css";
+    if (path.ends_with(".js")) return "application/javascript";
+    if (path.ends_with(".json")) return "application/json";
+    if (path.ends_with(".svg")) return "image/svg+xml";
+    if (path.ends_with(".mp4")) return "video/mp4";
+    if (path.ends_with(".jpg")) return "image/jpeg";
+    if (path.ends_with(".png")) return "image/png";
+    if (path.ends_with(".ico")) return "image/x-icon";
+    return "text/html";
+}
+
+std::shared_ptr<const StaticAsset> StaticAssetCache::loadAsset(const std::string& file_path,
+                                                               const std::string& url_path) {
+    std::ifstream file(file_path, std::ios::binary);
+    if (!file) {
+        return nullptr;
+    }
+
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+
+    auto asset = std::make_shared<StaticAsset>();
+    asset->identity = buffer.str();
+    asset->content_type = contentTypeFor(url_path);
+    asset->etag = "\"" + contentHash(asset->identity) + "\"";
+
+    // HTML is revalidated on every load so edits show up immediately;
+    // everything else may be reused for a while
+    asset->cache_control = asset->content_type == "text/html"
+        ? "no-cache"
+        : "public, max-age=3600";
+
+    if (isCompressible(asset->content_type)) {
+        asset->gzip = gzipCompress(asset->identity);
+        asset->brotli = brotliCompress(asset->identity);
+
+        // Only keep variants that are actually smaller
+        if (asset->gzip.size() >= asset->identity.size()) asset->gzip.clear();
+        if (asset->brotli.size() >= asset->identity.size()) asset->brotli.clear();
+    }
+
+    return asset;
+}
+
+void StaticAssetCache::load() {
+    auto assets = std::make_shared<AssetMap>();
+    size_t total_bytes = 0;
+
+    std::error_code ec;
+    for (auto it = fs::recursive_directory_iterator(web_root_, ec);
+         !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        if (!it->is_regular_file()) {
+            continue;
+        }
+
+        std::string url_path = "/" + fs::relative(it->path(), web_root_).generic_string();
+        auto asset = loadAsset(it->path().string(), url_path);
+        if (asset) {
+            total_bytes += asset->identity.size();
+            (*assets)[url_path] = std::move(asset);
+        }
+    }
+
+    if (ec) {
+        std::cerr << "[WEB] Failed to scan web root " << web_root_
+                  << ": " << ec.message() << std::endl;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(assets_mutex_);
+        assets_ = assets;
+    }
+
+    std::cout << "[WEB] Cached " << assets->size() << " static assets ("
+              << total_bytes << " bytes) from " << web_root_ << std::endl;
+}
+
+std::shared_ptr<const StaticAsset> StaticAssetCache::find(const std::string& path) const {
+    std::shared_ptr<const AssetMap> assets;
+    {
+        std::lock_guard<std::mutex> lock(assets_mutex_);
+        assets = assets_;
+    }
+
+    auto it = assets->find(path);
+    return it != assets->end() ? it->second : nullptr;
+}
+
+void StaticAssetCache::startWatching() {
+#ifdef __linux__
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd_ < 0) {
+        std::cerr << "[WEB] inotify unavailable, static assets will not auto-reload" << std::endl;
+        return;
+    }
+
+    running_ = true;
+    watch_thread_ = std::thread([this]() { watchLoop(); });
+#endif
+}
+
+void StaticAssetCache::stop() {
+    running_ = false;
+    if (watch_thread_.joinable()) {
+        watch_thread_.join();
+    }
+#ifdef __linux__
+    if (inotify_fd_ >= 0) {
+        close(inotify_fd_);
+        inotify_fd_ = -1;
+    }
+#endif
+}
+
+void StaticAssetCache::watchLoop() {
+#ifdef __linux__
+    const uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM |
+                          IN_CREATE | IN_DELETE | IN_DELETE_SELF;
+
+    auto addWatches = [this, mask]() {
+        inotify_add_watch(inotify_fd_, web_root_.c_str(), mask);
+        std::error_code ec;
+        for (auto it = fs::recursive_directory_iterator(web_root_, ec);
+             !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+            if (it->is_directory()) {
+                inotify_add_watch(inotify_fd_, it->path().c_str(), mask);
+            }
+        }
+    };
+
+    addWatches();
+
+    alignas(inotify_event) char events[4096];
+    while (running_) {
+        pollfd pfd{inotify_fd_, POLLIN, 0};
+        if (poll(&pfd, 1, 500) <= 0) {
+            continue;
+        }
+
+        // Editors write files in several steps; wait for the burst to settle
+        std::this_thread::sleep_for(std::chrono::milliseconds(RELOAD_DEBOUNCE_MS));
+        while (read(inotify_fd_, events, sizeof(events)) > 0) {
+        }
+
+        LOG_INFO("[WEB] Change detected in " << web_root_ << ", reloading assets");
+        addWatches();
+        load();
+    }
+#endif
+}
@@ -0,0 +1,145 @@
+#include "include/tracer.h"
+#include <chrono>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+#ifdef __linux__
+    #include <pthread.h>
+#endif
+
+static std::atomic<int> next_thread_track{1};
+static thread_local int thread_track = 0;
+
+static void appendEscaped(std::string& out, const std::string& value) {
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) >= 0x20) {
+            out += c;
+        }
+    }
+}
+
+Tracer::Tracer(double sample_rate, size_t capacity)
+    : sample_rate_(sample_rate), capacity_(capacity > 0 ? capacity : 1), next_(0) {
+}
+
+uint64_t Tracer::sample(double rate) {
+    if (rate <= 0) {
+        return 0;
+    }
+    thread_local std::mt19937_64 rng(std::random_device{}());
+    if (rate < 1 && std::uniform_real_distribution<double>(0, 1)(rng) >= rate) {
+        return 0;
+    }
+    uint64_t trace_id;
+    do {
+        trace_id = rng();
+    } while (trace_id == 0);
+    return trace_id;
+}
+
+int64_t Tracer::nowMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+std::string Tracer::formatId(uint64_t trace_id) {
+    char buffer[17];
+    snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(trace_id));
+    return buffer;
+}
+
+uint64_t Tracer::parseId(const std::string& text) {
+    if (text.empty() || text.size() > 16) {
+        return 0;
+    }
+    char* end = nullptr;
+    unsigned long long value = strtoull(text.c_str(), &end, 16);
+    return *end == '\0' ? static_cast<uint64_t>(value) : 0;
+}
+
+// The calling thread's track number. The first span from a thread also
+// remembers its name (consumer-N, grpcpp_sync_ser, ...) for the export.
+int Tracer::threadTrack() {
+    if (thread_track == 0) {
+        thread_track = next_thread_track++;
+    }
+    if (thread_names_.find(thread_track) == thread_names_.end()) {
+        std::string name = "thread-" + std::to_string(thread_track);
+#ifdef __linux__
+        char buffer[16];
+        if (pthread_getname_np(pthread_self(), buffer, sizeof(buffer)) == 0) {
+            name = buffer;
+        }
+#endif
+        thread_names_[thread_track] = name;
+    }
+    return thread_track;
+}
+
+void Tracer::record(uint64_t trace_id, const std::string& video_id, const char* name,
+                    int64_t start_us, int64_t end_us, Process process, int producer_id) {
+    if (trace_id == 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    Span span{trace_id, video_id, name, process,
+              process == Consumer ? threadTrack() : producer_id,
+              start_us, std::max<int64_t>(end_us - start_us, 0)};
+    if (spans_.size() < capacity_) {
+        spans_.push_back(std::move(span));
+    } else {
+        spans_[next_] = std::move(span);
+        next_ = (next_ + 1) % capacity_;
+    }
+}
+
+size_t Tracer::size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return spans_.size();
+}
+
+std::string Tracer::toJson() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string json;
+    json.reserve(128 + spans_.size() * 160);
+    json += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    json += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"consumer_server\"}},";
+    json += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,\"args\":{\"name\":\"producers\"}}";
+
+    std::unordered_map<int, bool> producer_tracks;
+    for (const auto& [track, name] : thread_names_) {
+        json += ",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" +
+                std::to_string(track) + ",\"args\":{\"name\":\"";
+        appendEscaped(json, name);
+        json += "\"}}";
+    }
+
+    // Oldest first, so the file reads in time order
+    for (size_t i = 0; i < spans_.size(); i++) {
+        const Span& span = spans_[(next_ + i) % spans_.size()];
+        if (span.process == Producer && !producer_tracks[span.thread]) {
+            producer_tracks[span.thread] = true;
+            json += ",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":2,\"tid\":" +
+                    std::to_string(span.thread) + ",\"args\":{\"name\":\"producer-" +
+                    std::to_string(span.thread) + "\"}}";
+        }
+
+        json += ",{\"name\":\"";
+        appendEscaped(json, span.name);
+        json += "\",\"cat\":\"upload\",\"ph\":\"X\",\"ts\":" + std::to_string(span.start_us) +
+                ",\"dur\":" + std::to_string(span.duration_us) +
+                ",\"pid\":" + std::to_string(static_cast<int>(span.process)) +
+                ",\"tid\":" + std::to_string(span.thread) +
+                ",\"args\":{\"video_id\":\"";
+        appendEscaped(json, span.video_id);
+        json += "\",\"trace_id\":\"" + formatId(span.trace_id) + "\"}}";
+    }
+    json += "]}";
+    return json;
+}
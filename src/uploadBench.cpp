@@ -0,0 +1,509 @@
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <openssl/evp.h>
+#include <grpcpp/grpcpp.h>
+#include "media_service.grpc.pb.h"
+#include "include/channelPool.h"
+#include "include/commandLine.h"
+
+// Synthetic load generator for consumer_server. Payloads are built in
+// memory from one random pool, so the numbers measure the upload path
+// and not the client's disk. Results go to stdout as JSON, progress to
+// stderr, so runs can be saved and compared across commits and configs.
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchOptions {
+    std::string server_address = "localhost:50051";
+    int streams = 4;
+    int uploads = 100;
+    double duration = 0;        // seconds; when set, overrides uploads
+    std::string size_spec = "fixed:1M";
+    double duplicate_ratio = 0;
+    double rate = 0;            // uploads/sec arrivals, 0 = closed loop
+    size_t chunk_size = 1024 * 1024;
+    int channels = 1;
+    bool legacy = false;        // UploadVideo with metadata in every chunk
+    bool checksum = true;
+    uint32_t seed = 1;
+};
+
+// Payload sizes drawn from "fixed:<size>", "uniform:<min>:<max>" or
+// "lognormal:<median>:<sigma>"
+class SizeDistribution {
+public:
+    bool parse(const std::string& spec);
+    size_t sample(std::mt19937_64& rng);
+
+private:
+    std::string kind_;
+    double a_ = 0;
+    double b_ = 0;
+};
+
+// What one upload sends: payload `id` decides the content, so repeating
+// an id repeats the bytes and the server sees a duplicate
+struct UploadJob {
+    uint64_t index;
+    uint64_t payload_id;
+    size_t size;
+    Clock::time_point scheduled;  // open loop: intended start
+};
+
+struct UploadResult {
+    enum Kind { Succeeded, Dropped, Duplicate, Failed } kind;
+    double latency_ms;
+    size_t bytes;
+};
+
+static constexpr size_t POOL_SIZE = 64 * 1024 * 1024;
+static constexpr size_t TAG_SIZE = 16;
+static constexpr size_t MIN_PAYLOAD = TAG_SIZE;
+static constexpr size_t MAX_PAYLOAD = 1024ull * 1024 * 1024;
+
+bool SizeDistribution::parse(const std::string& spec) {
+    std::vector<std::string> fields;
+    std::stringstream ss(spec);
+    std::string field;
+    while (std::getline(ss, field, ':')) {
+        fields.push_back(field);
+    }
+    if (fields.empty()) {
+        return false;
+    }
+
+    kind_ = fields[0];
+    uint64_t low = 0;
+    uint64_t high = 0;
+    if (kind_ == "fixed" && fields.size() == 2) {
+        if (!parseQuantity(fields[1], 1024, low)) {
+            return false;
+        }
+        a_ = static_cast<double>(low);
+        return true;
+    }
+    if (kind_ == "uniform" && fields.size() == 3) {
+        if (!parseQuantity(fields[1], 1024, low) || !parseQuantity(fields[2], 1024, high) ||
+            low > high) {
+            return false;
+        }
+        a_ = static_cast<double>(low);
+        b_ = static_cast<double>(high);
+        return true;
+    }
+    if (kind_ == "lognormal" && fields.size() == 3) {
+        try {
+            b_ = std::stod(fields[2]);
+        } catch (const std::exception&) {
+            return false;
+        }
+        if (!parseQuantity(fields[1], 1024, low) || low == 0 || b_ < 0) {
+            return false;
+        }
+        a_ = static_cast<double>(low);
+        return true;
+    }
+    return false;
+}
+
+size_t SizeDistribution::sample(std::mt19937_64& rng) {
+    double size = a_;
+    if (kind_ == "uniform") {
+        size = std::uniform_real_distribution<double>(a_, b_)(rng);
+    } else if (kind_ == "lognormal") {
+        size = std::lognormal_distribution<double>(std::log(a_), b_)(rng);
+    }
+    return std::clamp(static_cast<size_t>(size), MIN_PAYLOAD, static_cast<size_t>(MAX_PAYLOAD));
+}
+
+// Hands out jobs to the sender threads in order, deciding sizes,
+// duplicates and (open loop) arrival times from one seeded generator
+class JobSource {
+public:
+    JobSource(const BenchOptions& options, SizeDistribution sizes)
+        : options_(options), sizes_(std::move(sizes)), rng_(options.seed),
+          next_index_(0), next_arrival_(Clock::now()), start_(Clock::now()) {}
+
+    bool next(UploadJob& job) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto now = Clock::now();
+        if (options_.duration > 0) {
+            auto end = start_ + std::chrono::duration<double>(options_.duration);
+            if ((options_.rate > 0 ? next_arrival_ : now) >= end) {
+                return false;
+            }
+        } else if (next_index_ >= static_cast<uint64_t>(options_.uploads)) {
+            return false;
+        }
+
+        job.index = next_index_++;
+        std::uniform_real_distribution<double> coin(0, 1);
+        if (!payload_sizes_.empty() && coin(rng_) < options_.duplicate_ratio) {
+            std::uniform_int_distribution<size_t> pick(0, payload_sizes_.size() - 1);
+            job.payload_id = pick(rng_);
+        } else {
+            job.payload_id = payload_sizes_.size();
+            payload_sizes_.push_back(sizes_.sample(rng_));
+        }
+        job.size = payload_sizes_[job.payload_id];
+
+        // Poisson arrivals; a job that starts late because every stream
+        // is busy has the wait counted in its latency
+        job.scheduled = options_.rate > 0 ? next_arrival_ : now;
+        if (options_.rate > 0) {
+            std::exponential_distribution<double> gap(options_.rate);
+            next_arrival_ += std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(gap(rng_)));
+        }
+        return true;
+    }
+
+    Clock::time_point start() const { return start_; }
+
+private:
+    BenchOptions options_;
+    SizeDistribution sizes_;
+    std::mt19937_64 rng_;
+    std::vector<size_t> payload_sizes_;
+    uint64_t next_index_;
+    Clock::time_point next_arrival_;
+    Clock::time_point start_;
+    std::mutex mutex_;
+};
+
+// Fills `out` with bytes [offset, offset + length) of payload `id`: a
+// 16-byte tag naming the payload, then the random pool from an offset
+// picked by the id, wrapping around at the end
+static void payloadBytes(const std::vector<char>& pool, uint64_t id, uint32_t seed,
+                         size_t offset, size_t length, std::string& out) {
+    out.resize(length);
+    char tag[TAG_SIZE];
+    uint64_t words[2] = {id, seed};
+    std::memcpy(tag, words, TAG_SIZE);
+
+    size_t written = 0;
+    for (; offset + written < TAG_SIZE && written < length; written++) {
+        out[written] = tag[offset + written];
+    }
+
+    size_t start = static_cast<size_t>((id * 2654435761ull) % POOL_SIZE);
+    while (written < length) {
+        size_t pool_offset = (start + offset + written - TAG_SIZE) % POOL_SIZE;
+        size_t piece = std::min(length - written, POOL_SIZE - pool_offset);
+        std::memcpy(&out[written], pool.data() + pool_offset, piece);
+        written += piece;
+    }
+}
+
+static std::string toHex(const unsigned char* data, unsigned int length) {
+    std::stringstream ss;
+    for (unsigned int i = 0; i < length; i++) {
+        ss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(data[i]);
+    }
+    return ss.str();
+}
+
+static UploadResult::Kind classify(const grpc::Status& status,
+                                   const mediaupload::UploadResponse& response) {
+    if (!status.ok()) {
+        return status.error_code() == grpc::StatusCode::RESOURCE_EXHAUSTED
+            ? UploadResult::Dropped : UploadResult::Failed;
+    }
+    if (response.success()) {
+        return UploadResult::Succeeded;
+    }
+    switch (response.result()) {
+        case mediaupload::UploadResponse::DUPLICATE:
+            return UploadResult::Duplicate;
+        case mediaupload::UploadResponse::QUEUE_FULL:
+            return UploadResult::Dropped;
+        default:
+            return UploadResult::Failed;
+    }
+}
+
+static UploadResult runUpload(ChannelPool& channels, const BenchOptions& options,
+                              const std::vector<char>& pool, const UploadJob& job,
+                              EVP_MD_CTX* sha) {
+    ChannelPool::Lease lease = channels.acquire();
+    grpc::ClientContext context;
+    mediaupload::UploadResponse response;
+    std::string video_id = "BENCH_" + std::to_string(options.seed) + "_" + std::to_string(job.index);
+    std::string filename = "bench_" + std::to_string(job.payload_id) + ".mp4";
+
+    if (options.checksum) {
+        EVP_DigestInit_ex(sha, EVP_sha256(), nullptr);
+    }
+
+    bool sent = true;
+    grpc::Status status;
+    if (options.legacy) {
+        auto writer = lease.stub()->UploadVideo(&context, &response);
+        mediaupload::VideoChunk chunk;
+        chunk.set_video_id(video_id);
+        chunk.set_filename(filename);
+        chunk.set_total_size(job.size);
+        int chunk_number = 0;
+        for (size_t offset = 0; sent && offset < job.size; offset += options.chunk_size) {
+            size_t length = std::min(options.chunk_size, job.size - offset);
+            payloadBytes(pool, job.payload_id, options.seed, offset, length, *chunk.mutable_data());
+            chunk.set_chunk_number(chunk_number++);
+            chunk.set_is_last(offset + length == job.size);
+            sent = writer->Write(chunk);
+        }
+        writer->WritesDone();
+        status = writer->Finish();
+    } else {
+        auto writer = lease.stub()->UploadVideoFrames(&context, &response);
+        mediaupload::UploadFrame frame;
+        auto* header = frame.mutable_header();
+        header->set_video_id(video_id);
+        header->set_filename(filename);
+        header->set_total_size(job.size);
+        sent = writer->Write(frame);
+
+        for (size_t offset = 0; sent && offset < job.size; offset += options.chunk_size) {
+            size_t length = std::min(options.chunk_size, job.size - offset);
+            payloadBytes(pool, job.payload_id, options.seed, offset, length, *frame.mutable_data());
+            bool is_last = offset + length == job.size;
+            frame.set_is_last(is_last);
+            if (options.checksum) {
+                EVP_DigestUpdate(sha, frame.data().data(), length);
+                if (is_last) {
+                    unsigned char digest[EVP_MAX_MD_SIZE];
+                    unsigned int digest_length = 0;
+                    EVP_DigestFinal_ex(sha, digest, &digest_length);
+                    frame.set_sha256(toHex(digest, digest_length));
+                }
+            }
+            sent = writer->Write(frame);
+        }
+        writer->WritesDone();
+        status = writer->Finish();
+    }
+
+    UploadResult result;
+    result.kind = classify(status, response);
+    result.latency_ms = std::chrono::duration<double, std::milli>(Clock::now() - job.scheduled).count();
+    result.bytes = job.size;
+    return result;
+}
+
+static double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+    return sorted[std::min(sorted.size() - 1, index > 0 ? index - 1 : 0)];
+}
+
+static std::string jsonString(const std::string& value) {
+    std::string out = "\"";
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += c;
+    }
+    return out + "\"";
+}
+
+void printUsage(const char* program_name) {
+    std::cout << "Usage: " << program_name << " [-s <server>] [-n <streams>] [-u <uploads> | -t <seconds>]"
+              << " [-z <sizes>] [-d <ratio>] [-r <rate>] [-c <chunk>] [-k <channels>] [-l] [-x] [-e <seed>]\n";
+    std::cout << "\nOptions:\n";
+    std::cout << "  -s <server>    Server address (default: localhost:50051)\n";
+    std::cout << "  -n <streams>   Concurrent upload streams (default: 4)\n";
+    std::cout << "  -u <uploads>   Number of uploads (default: 100)\n";
+    std::cout << "  -t <seconds>   Run for a fixed time instead of a fixed number of uploads\n";
+    std::cout << "  -z <sizes>     Payload sizes (default: fixed:1M):\n";
+    std::cout << "                   fixed:<size>\n";
+    std::cout << "                   uniform:<min>:<max>\n";
+    std::cout << "                   lognormal:<median>:<sigma>\n";
+    std::cout << "  -d <ratio>     Share of uploads repeating an earlier payload (default: 0)\n";
+    std::cout << "  -r <rate>      Open loop: start uploads at <rate>/s with Poisson arrivals,\n";
+    std::cout << "                 latency counted from the arrival (default: 0, closed loop)\n";
+    std::cout << "  -c <chunk>     Chunk size (default: 1M)\n";
+    std::cout << "  -k <channels>  Connections to the server (default: 1)\n";
+    std::cout << "  -l             Use the legacy UploadVideo stream\n";
+    std::cout << "  -x             Send no checksum\n";
+    std::cout << "  -e <seed>      Random seed; the same seed sends the same payloads (default: 1)\n";
+    std::cout << "\nSizes accept K, M and G suffixes (powers of 1024).\n";
+    std::cout << "Every accepted upload is written by the server; point it at scratch space.\n";
+    std::cout << "\nExample:\n";
+    std::cout << "  " << program_name << " -n 8 -u 500 -z lognormal:2M:1 -d 0.1 > run.json\n";
+    std::cout << "  " << program_name << " -n 16 -t 30 -r 50 -z uniform:256K:8M\n";
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        try {
+            if (arg == "-s" && i + 1 < argc) {
+                options.server_address = argv[++i];
+            } else if (arg == "-n" && i + 1 < argc) {
+                options.streams = std::stoi(argv[++i]);
+            } else if (arg == "-u" && i + 1 < argc) {
+                options.uploads = std::stoi(argv[++i]);
+            } else if (arg == "-t" && i + 1 < argc) {
+                options.duration = std::stod(argv[++i]);
+            } else if (arg == "-z" && i + 1 < argc) {
+                options.size_spec = argv[++i];
+            } else if (arg == "-d" && i + 1 < argc) {
+                options.duplicate_ratio = std::stod(argv[++i]);
+            } else if (arg == "-r" && i + 1 < argc) {
+                options.rate = std::stod(argv[++i]);
+            } else if (arg == "-c" && i + 1 < argc) {
+                uint64_t chunk_size;
+                if (!parseQuantity(argv[++i], 1024, chunk_size) || chunk_size < 1024 ||
+                    chunk_size > 8 * 1024 * 1024) {
+                    std::cerr << "Error: Chunk size must be between 1K and 8M" << std::endl;
+                    return 1;
+                }
+                options.chunk_size = static_cast<size_t>(chunk_size);
+            } else if (arg == "-k" && i + 1 < argc) {
+                options.channels = std::stoi(argv[++i]);
+            } else if (arg == "-l") {
+                options.legacy = true;
+            } else if (arg == "-x") {
+                options.checksum = false;
+            } else if (arg == "-e" && i + 1 < argc) {
+                options.seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+            } else if (arg == "-h" || arg == "--help") {
+                printUsage(argv[0]);
+                return 0;
+            } else {
+                std::cerr << "Unknown argument: " << arg << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+        } catch (const std::exception&) {
+            std::cerr << "Error: Invalid value for " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    SizeDistribution sizes;
+    if (!sizes.parse(options.size_spec)) {
+        std::cerr << "Error: Invalid size distribution: " << options.size_spec << std::endl;
+        return 1;
+    }
+    if (options.streams < 1 || options.channels < 1 || options.uploads < 1 ||
+        options.duplicate_ratio < 0 || options.duplicate_ratio > 1 || options.rate < 0) {
+        std::cerr << "Error: Invalid options" << std::endl;
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::cerr << "[BENCH] Generating " << POOL_SIZE / (1024 * 1024) << " MB payload pool" << std::endl;
+    std::vector<char> pool(POOL_SIZE);
+    std::mt19937_64 pool_rng(options.seed);
+    for (size_t i = 0; i + sizeof(uint64_t) <= pool.size(); i += sizeof(uint64_t)) {
+        uint64_t word = pool_rng();
+        std::memcpy(&pool[i], &word, sizeof(word));
+    }
+
+    ChannelPool channels(options.server_address, options.channels);
+    JobSource jobs(options, sizes);
+    std::vector<UploadResult> results;
+    std::mutex results_mutex;
+    std::atomic<uint64_t> completed{0};
+
+    std::cerr << "[BENCH] " << options.streams << " streams, "
+              << (options.rate > 0 ? "open loop" : "closed loop") << " against "
+              << options.server_address << std::endl;
+
+    auto start = Clock::now();
+    std::vector<std::thread> senders;
+    for (int i = 0; i < options.streams; i++) {
+        senders.emplace_back([&]() {
+            EVP_MD_CTX* sha = EVP_MD_CTX_new();
+            UploadJob job;
+            while (jobs.next(job)) {
+                std::this_thread::sleep_until(job.scheduled);
+                UploadResult result = runUpload(channels, options, pool, job, sha);
+                {
+                    std::lock_guard<std::mutex> lock(results_mutex);
+                    results.push_back(result);
+                }
+                uint64_t done = ++completed;
+                if (done % 100 == 0) {
+                    std::cerr << "[BENCH] " << done << " uploads done" << std::endl;
+                }
+            }
+            EVP_MD_CTX_free(sha);
+        });
+    }
+    for (auto& sender : senders) {
+        sender.join();
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    uint64_t counts[4] = {0, 0, 0, 0};
+    // Dropped and failed uploads were sent too, but the server kept none
+    // of them, so throughput counts only the delivered bytes
+    uint64_t bytes_sent = 0;
+    uint64_t bytes_delivered = 0;
+    std::vector<double> latencies;
+    for (const auto& result : results) {
+        counts[result.kind]++;
+        bytes_sent += result.bytes;
+        if (result.kind == UploadResult::Succeeded || result.kind == UploadResult::Duplicate) {
+            bytes_delivered += result.bytes;
+        }
+        latencies.push_back(result.latency_ms);
+    }
+    std::sort(latencies.begin(), latencies.end());
+    double mean = 0;
+    for (double latency : latencies) {
+        mean += latency / latencies.size();
+    }
+    double total = std::max<size_t>(1, results.size());
+
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "{\n";
+    std::cout << "  \"config\": {\"server\": " << jsonString(options.server_address)
+              << ", \"streams\": " << options.streams
+              << ", \"mode\": \"" << (options.rate > 0 ? "open" : "closed") << "\""
+              << ", \"rate\": " << options.rate
+              << ", \"sizes\": " << jsonString(options.size_spec)
+              << ", \"duplicate_ratio\": " << options.duplicate_ratio
+              << ", \"chunk_size\": " << options.chunk_size
+              << ", \"channels\": " << options.channels
+              << ", \"rpc\": \"" << (options.legacy ? "UploadVideo" : "UploadVideoFrames") << "\""
+              << ", \"checksum\": " << (options.checksum ? "true" : "false")
+              << ", \"seed\": " << options.seed << "},\n";
+    std::cout << "  \"uploads\": " << results.size() << ",\n";
+    std::cout << "  \"succeeded\": " << counts[UploadResult::Succeeded] << ",\n";
+    std::cout << "  \"dropped\": " << counts[UploadResult::Dropped] << ",\n";
+    std::cout << "  \"duplicates\": " << counts[UploadResult::Duplicate] << ",\n";
+    std::cout << "  \"failed\": " << counts[UploadResult::Failed] << ",\n";
+    std::cout << "  \"drop_rate\": " << counts[UploadResult::Dropped] / total << ",\n";
+    std::cout << "  \"elapsed_s\": " << elapsed << ",\n";
+    std::cout << "  \"bytes_sent\": " << bytes_sent << ",\n";
+    std::cout << "  \"bytes_delivered\": " << bytes_delivered << ",\n";
+    std::cout << "  \"throughput_mb_s\": " << bytes_delivered / 1e6 / elapsed << ",\n";
+    std::cout << "  \"sent_mb_s\": " << bytes_sent / 1e6 / elapsed << ",\n";
+    std::cout << "  \"uploads_per_s\": " << results.size() / elapsed << ",\n";
+    std::cout << "  \"latency_ms\": {\"mean\": " << mean
+              << ", \"p50\": " << percentile(latencies, 50)
+              << ", \"p90\": " << percentile(latencies, 90)
+              << ", \"p99\": " << percentile(latencies, 99)
+              << ", \"p999\": " << percentile(latencies, 99.9)
+              << ", \"max\": " << (latencies.empty() ? 0 : latencies.back()) << "}\n";
+    std::cout << "}" << std::endl;
+    return 0;
+}
@@ -0,0 +1,143 @@
+#include "include/uploadCredits.h"
+#include "include/logger.h"
+#include <iostream>
+#include <algorithm>
+
+UploadCredits::UploadCredits(ChannelPool::Stub* stub)
+    : stub_(stub), available_(0), subscription_id_(0), connected_(false), disconnects_(0),
+      stopping_(false) {
+    reader_ = std::thread([this]() { run(); });
+}
+
+UploadCredits::~UploadCredits() {
+    stop();
+}
+
+void UploadCredits::run() {
+    int backoff_ms = MIN_RECONNECT_MS;
+    bool was_connected = false;
+    while (true) {
+        auto context = std::make_unique<grpc::ClientContext>();
+        std::shared_ptr<Stream> stream;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_) {
+                break;
+            }
+            stream = stub_->Subscribe(context.get());
+            context_ = std::move(context);
+        }
+        {
+            std::lock_guard<std::mutex> lock(write_mutex_);
+            stream_ = stream;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            connected_ = true;
+        }
+
+        auto opened = std::chrono::steady_clock::now();
+        bool retry = readGrants(*stream);
+
+        // Credits of the old subscription mean nothing to the server anymore
+        {
+            std::lock_guard<std::mutex> lock(write_mutex_);
+            stream_.reset();
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        bool got_grants = subscription_id_ != 0;
+        connected_ = false;
+        disconnects_++;
+        available_ = 0;
+        subscription_id_ = 0;
+        cv_.notify_all();
+        if (!retry || stopping_) {
+            break;
+        }
+
+        // A stream that stayed up a while was a working one: start over
+        if (std::chrono::steady_clock::now() - opened > std::chrono::milliseconds(MAX_RECONNECT_MS)) {
+            backoff_ms = MIN_RECONNECT_MS;
+        }
+        if (got_grants || was_connected) {
+            LOG_INFO("[PRODUCER] Credit stream lost, reconnecting in " << backoff_ms << " ms");
+        }
+        was_connected = was_connected || got_grants;
+        cv_.wait_for(lock, std::chrono::milliseconds(backoff_ms), [this]() { return stopping_; });
+        backoff_ms = std::min(backoff_ms * 2, MAX_RECONNECT_MS);
+    }
+}
+
+bool UploadCredits::readGrants(Stream& stream) {
+    mediaupload::CreditGrant grant;
+    bool first = true;
+    while (stream.Read(&grant)) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (first && subscription_id_ == 0) {
+            LOG_DEBUG("[PRODUCER] Credit subscription #" << grant.subscription_id() << " open");
+        }
+        first = false;
+        available_ += grant.credits();
+        subscription_id_ = grant.subscription_id();
+        cv_.notify_all();
+    }
+
+    grpc::Status status = stream.Finish();
+    if (status.error_code() == grpc::StatusCode::UNIMPLEMENTED) {
+        LOG_INFO("[PRODUCER] Server does not grant upload credits, "
+                 << "polling queue status instead");
+        return false;
+    }
+    return true;
+}
+
+bool UploadCredits::acquire() {
+    uint64_t disconnects;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!connected_ || stopping_) {
+            return false;
+        }
+        disconnects = disconnects_;
+    }
+
+    mediaupload::CreditRequest request;
+    request.set_credits(1);
+    {
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        if (!stream_ || !stream_->Write(request)) {
+            return false;
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    // A request made on a stream that has since broken is never answered,
+    // even once a new stream is up
+    cv_.wait(lock, [this, disconnects]() {
+        return available_ > 0 || disconnects_ != disconnects || stopping_;
+    });
+    if (disconnects_ != disconnects || available_ == 0) {
+        return false;
+    }
+    available_--;
+    return true;
+}
+
+uint64_t UploadCredits::subscriptionId() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return subscription_id_;
+}
+
+void UploadCredits::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        if (context_) {
+            context_->TryCancel();
+        }
+    }
+    cv_.notify_all();
+    if (reader_.joinable()) {
+        reader_.join();
+    }
+}
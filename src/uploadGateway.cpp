@@ -0,0 +1,299 @@
+#include "include/uploadGateway.h"
+#include "include/logger.h"
+#include <iostream>
+#include <algorithm>
+#include <functional>
+
+#ifdef __linux__
+    #include <pthread.h>
+#endif
+
+UploadGateway::UploadGateway(const std::vector<std::string>& backend_addresses)
+    : running_(false), rejected_(0) {
+    for (const auto& address : backend_addresses) {
+        auto backend = std::make_unique<Backend>();
+        backend->address = address;
+        backend->stub = mediaupload::MediaUploadService::NewStub(
+            grpc::CreateChannel(address, grpc::InsecureChannelCredentials()));
+        backends_.push_back(std::move(backend));
+    }
+}
+
+UploadGateway::~UploadGateway() {
+    stop();
+}
+
+void UploadGateway::start() {
+    poll();  // know the pool before the first upload arrives
+    for (const auto& backend : backends_) {
+        std::cout << "  Backend " << backend->address << ": "
+                  << (backend->reachable ? "queue " + std::to_string(backend->queue_size) + "/" +
+                                           std::to_string(backend->max_size)
+                                         : std::string("not reachable yet"))
+                  << std::endl;
+    }
+
+    running_ = true;
+    poller_ = std::thread([this]() { pollBackends(); });
+}
+
+void UploadGateway::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    stop_cv_.notify_all();
+    if (poller_.joinable()) {
+        poller_.join();
+        printStatistics();
+    }
+}
+
+void UploadGateway::pollBackends() {
+#ifdef __linux__
+    pthread_setname_np(pthread_self(), "gateway-poll");
+#endif
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_) {
+        stop_cv_.wait_for(lock, std::chrono::milliseconds(POLL_INTERVAL_MS));
+        if (!running_) {
+            break;
+        }
+        lock.unlock();
+        poll();
+        lock.lock();
+    }
+}
+
+void UploadGateway::poll() {
+    for (auto& backend : backends_) {
+        grpc::ClientContext context;
+        context.set_deadline(std::chrono::system_clock::now() +
+                             std::chrono::milliseconds(POLL_INTERVAL_MS));
+        QueueStatusRequest request;
+        QueueStatusResponse status;
+        bool reachable = backend->stub->GetQueueStatus(&context, request, &status).ok();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (running_ && reachable != backend->reachable) {
+            LOG_INFO("[GATEWAY] Backend " << backend->address
+                     << (reachable ? " is up" : " is down"));
+        }
+        backend->reachable = reachable;
+        if (reachable) {
+            backend->free_slots = status.available_slots();
+            backend->max_size = status.max_size();
+            backend->queue_size = status.current_size();
+            // Uploads still streaming haven't reached the backend's queue
+            backend->pending = backend->active;
+        }
+    }
+}
+
+int UploadGateway::pickBackend() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int best = -1;
+    int best_slots = 0;
+    for (size_t i = 0; i < backends_.size(); i++) {
+        const Backend& backend = *backends_[i];
+        int slots = backend.free_slots - backend.pending;
+        if (backend.reachable && slots > best_slots) {
+            best = static_cast<int>(i);
+            best_slots = slots;
+        }
+    }
+    if (best >= 0) {
+        backends_[best]->pending++;
+    }
+    return best;
+}
+
+void UploadGateway::finishUpload(int backend, const Status& status,
+                                 const UploadResponse& response) {
+    Backend& target = *backends_[backend];
+    if (status.ok() && response.success()) {
+        target.uploads++;
+    } else if (status.error_code() == grpc::StatusCode::UNAVAILABLE) {
+        target.failures++;
+        std::lock_guard<std::mutex> lock(mutex_);
+        target.reachable = false;  // until the next poll says otherwise
+    }
+}
+
+void UploadGateway::copyMetadata(const ServerContext* from, grpc::ClientContext& to) {
+    const auto& metadata = from->client_metadata();
+    auto it = metadata.find(Tracer::METADATA_KEY);
+    if (it != metadata.end()) {
+        to.AddMetadata(Tracer::METADATA_KEY, std::string(it->second.data(), it->second.size()));
+    }
+}
+
+// Passes messages on as they arrive; only the one in hand is held
+template <typename Message>
+static Status forwardStream(ServerReader<Message>* reader,
+                            grpc::ClientContext& backend_context,
+                            grpc::ClientWriter<Message>& writer,
+                            const std::function<void(Message&)>& prepare) {
+    Message message;
+    bool complete = false;
+    bool backend_ended = false;
+    while (reader->Read(&message)) {
+        prepare(message);
+        bool last = message.is_last();
+        if (!writer.Write(message)) {
+            backend_ended = true;  // Finish() says why
+            break;
+        }
+        if (last) {
+            complete = true;
+            break;
+        }
+    }
+
+    if (complete) {
+        writer.WritesDone();
+    } else if (!backend_ended) {
+        // The producer went away, or its stream ended without the last
+        // message; a clean end would hand the backend a truncated upload
+        backend_context.TryCancel();
+    }
+    return writer.Finish();
+}
+
+Status UploadGateway::UploadVideo(ServerContext* context,
+                                  ServerReader<VideoChunk>* reader,
+                                  UploadResponse* response) {
+    int backend = pickBackend();
+    if (backend < 0) {
+        rejected_++;
+        return Status(grpc::StatusCode::RESOURCE_EXHAUSTED, "All backends are full");
+    }
+    Backend& target = *backends_[backend];
+    target.active++;
+
+    grpc::ClientContext backend_context;
+    copyMetadata(context, backend_context);
+    auto writer = target.stub->UploadVideo(&backend_context, response);
+    Status status = forwardStream<VideoChunk>(reader, backend_context, *writer,
+                                              [](VideoChunk&) {});
+
+    target.active--;
+    finishUpload(backend, status, *response);
+    return status;
+}
+
+Status UploadGateway::UploadVideoFrames(ServerContext* context,
+                                        ServerReader<UploadFrame>* reader,
+                                        UploadResponse* response) {
+    int backend = pickBackend();
+    if (backend < 0) {
+        rejected_++;
+        return Status(grpc::StatusCode::RESOURCE_EXHAUSTED, "All backends are full");
+    }
+    Backend& target = *backends_[backend];
+    target.active++;
+
+    grpc::ClientContext backend_context;
+    copyMetadata(context, backend_context);
+    auto writer = target.stub->UploadVideoFrames(&backend_context, response);
+    Status status = forwardStream<UploadFrame>(reader, backend_context, *writer,
+                                               [](UploadFrame& frame) {
+        // Credits are never handed out here, so none can be redeemed
+        if (frame.has_header()) {
+            frame.mutable_header()->set_credit_id(0);
+        }
+    });
+
+    target.active--;
+    finishUpload(backend, status, *response);
+    return status;
+}
+
+Status UploadGateway::Subscribe(ServerContext* /*context*/,
+                                ServerReaderWriter<CreditGrant, CreditRequest>* /*stream*/) {
+    return Status(grpc::StatusCode::UNIMPLEMENTED,
+                  "Upload credits are not available through the gateway");
+}
+
+Status UploadGateway::GetQueueStatus(ServerContext* /*context*/,
+                                     const QueueStatusRequest* /*request*/,
+                                     QueueStatusResponse* response) {
+    int current_size = 0;
+    int max_size = 0;
+    int available = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& backend : backends_) {
+            if (!backend->reachable) {
+                continue;
+            }
+            current_size += backend->queue_size;
+            max_size += backend->max_size;
+            available += std::max(0, backend->free_slots - backend->pending);
+        }
+    }
+
+    response->set_current_size(current_size);
+    response->set_max_size(max_size);
+    response->set_is_full(available == 0);
+    response->set_available_slots(available);
+    return Status::OK;
+}
+
+Status UploadGateway::GetStatistics(ServerContext* /*context*/,
+                                    const StatisticsRequest* /*request*/,
+                                    StatisticsResponse* response) {
+    // Asked of every backend at once, so one slow backend costs its own
+    // deadline and not the sum of them all
+    std::vector<StatisticsResponse> replies(backends_.size());
+    std::vector<std::unique_ptr<grpc::ClientContext>> contexts;
+    std::vector<std::thread> calls;
+    std::vector<char> answered(backends_.size(), 0);
+    for (size_t i = 0; i < backends_.size(); i++) {
+        contexts.push_back(std::make_unique<grpc::ClientContext>());
+        contexts[i]->set_deadline(std::chrono::system_clock::now() + std::chrono::seconds(2));
+        calls.emplace_back([this, i, &replies, &contexts, &answered]() {
+            StatisticsRequest backend_request;
+            answered[i] = backends_[i]->stub->GetStatistics(contexts[i].get(), backend_request,
+                                                            &replies[i]).ok();
+        });
+    }
+    for (auto& call : calls) {
+        call.join();
+    }
+
+    bool memory_unlimited = false;
+    for (size_t i = 0; i < replies.size(); i++) {
+        if (!answered[i]) {
+            continue;
+        }
+        memory_unlimited = memory_unlimited || replies[i].memory_limit() == 0;
+        const StatisticsResponse& reply = replies[i];
+        response->set_total_received(response->total_received() + reply.total_received());
+        response->set_total_processed(response->total_processed() + reply.total_processed());
+        response->set_total_dropped(response->total_dropped() + reply.total_dropped());
+        response->set_total_duplicates(response->total_duplicates() + reply.total_duplicates());
+        response->set_queue_size(response->queue_size() + reply.queue_size());
+        response->set_memory_in_use(response->memory_in_use() + reply.memory_in_use());
+        response->set_memory_limit(response->memory_limit() + reply.memory_limit());
+        response->set_memory_waits(response->memory_waits() + reply.memory_waits());
+        response->set_memory_blocked_ms(response->memory_blocked_ms() + reply.memory_blocked_ms());
+    }
+    if (memory_unlimited) {
+        response->set_memory_limit(0);
+    }
+    return Status::OK;
+}
+
+void UploadGateway::printStatistics() {
+    Logger::instance().flush();
+    std::cout << "\n=== Gateway Statistics ===" << std::endl;
+    for (const auto& backend : backends_) {
+        std::cout << backend->address << ": " << backend->uploads << " uploads";
+        if (backend->failures > 0) {
+            std::cout << ", " << backend->failures << " connection failures";
+        }
+        std::cout << std::endl;
+    }
+    std::cout << "Refused, pool full: " << rejected_ << std::endl;
+}
@@ -0,0 +1,88 @@
+#include "include/uploadLedger.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+// The same file reached through different relative paths is one entry
+static std::string keyFor(const std::string& path) {
+    std::error_code ec;
+    fs::path absolute = fs::absolute(path, ec);
+    return ec ? path : absolute.lexically_normal().string();
+}
+
+UploadLedger::~UploadLedger() {
+    if (file_) {
+        fclose(file_);
+    }
+}
+
+bool UploadLedger::open(const std::string& path) {
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        Entry entry;
+        std::string file_path;
+        // A torn last line from a crash is simply ignored
+        if (fields >> entry.size >> entry.mtime && fields.get() == ' ' &&
+            std::getline(fields, file_path) && !file_path.empty()) {
+            uploaded_[file_path] = entry;
+        }
+    }
+    in.close();
+
+    file_ = fopen(path.c_str(), "a");
+    if (!file_) {
+        std::cerr << "[PRODUCER] Cannot write upload record " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool UploadLedger::claim(const std::string& path, uint64_t size, int64_t mtime) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string key = keyFor(path);
+    Entry entry{size, mtime};
+    auto it = uploaded_.find(key);
+    if (it != uploaded_.end() && it->second == entry) {
+        return false;
+    }
+    return claimed_.emplace(key, entry).second;
+}
+
+void UploadLedger::commit(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string key = keyFor(path);
+    auto it = claimed_.find(key);
+    if (it == claimed_.end()) {
+        return;
+    }
+    Entry entry = it->second;
+    claimed_.erase(it);
+    uploaded_[key] = entry;
+
+    if (file_) {
+        // Flushed per line so a killed client loses nothing it reported
+        fprintf(file_, "%llu %lld %s\n", static_cast<unsigned long long>(entry.size),
+                static_cast<long long>(entry.mtime), key.c_str());
+        fflush(file_);
+    }
+}
+
+void UploadLedger::release(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    claimed_.erase(keyFor(path));
+}
+
+bool UploadLedger::isClaimed(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return claimed_.count(keyFor(path)) > 0;
+}
+
+size_t UploadLedger::uploadedCount() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return uploaded_.size();
+}
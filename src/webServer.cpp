@@ -1,9 +1,19 @@
 #include "include/webServer.h"
+#include "include/logger.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <cstring>
 #include <thread>
+#include <algorithm>
+#include <cctype>
+#include <vector>
+#include <filesystem>
+#include <charconv>
+#include <string_view>
+#include <optional>
+#include <chrono>
+#include <cerrno>
 
 #ifdef _WIN32
     #include <winsock2.h>
@@ -14,17 +24,35 @@
     #include <unistd.h>
     #include <sys/socket.h>
     #include <netinet/in.h>
+    #include <netinet/tcp.h>
     #include <arpa/inet.h>
+    #include <sys/time.h>
+    #include <fcntl.h>
     #define closesocket close
     typedef int SOCKET;
     #define INVALID_SOCKET -1
     #define SOCKET_ERROR -1
 #endif
+#ifdef __linux__
+    #include <sys/sendfile.h>
+#endif
+
+// A write to a client that has gone away fails with EPIPE instead of
+// raising SIGPIPE, which would take the whole server down
+#ifdef MSG_NOSIGNAL
+    #define SEND_FLAGS MSG_NOSIGNAL
+#else
+    #define SEND_FLAGS 0
+#endif
+
+namespace fs = std::filesystem;
 
 WebServer::WebServer(int port, ConsumerServer* consumer_server, 
-                     const std::string& web_root)
+                     const std::string& web_root, int max_events_per_sec)
     : port_(port), consumer_server_(consumer_server), 
-      web_root_(web_root), running_(false) {
+      web_root_(web_root), asset_cache_(web_root),
+      max_events_per_sec_(std::max(1, max_events_per_sec)), running_(false),
+      listen_fd_(INVALID_SOCKET), videos_json_version_(0) {
 #ifdef _WIN32
     WSADATA wsaData;
     int result = WSAStartup(MAKEWORD(2, 2), &wsaData);
@@ -42,6 +70,10 @@ WebServer::~WebServer() {
 }
 
 void WebServer::start() {
+    // Load web assets up front so page loads never touch the disk
+    asset_cache_.load();
+    asset_cache_.startWatching();
+
     running_ = true;
     server_thread_ = std::thread([this]() { run(); });
     std::cout << "Web server started on http://localhost:" << port_ << std::endl;
@@ -49,12 +81,39 @@ void WebServer::start() {
 
 void WebServer::stop() {
     running_ = false;
+    SOCKET listen_fd = listen_fd_.exchange(INVALID_SOCKET);
+    if (listen_fd != INVALID_SOCKET) {
+#ifdef _WIN32
+        closesocket(listen_fd);
+#else
+        shutdown(listen_fd, SHUT_RDWR);  // accept() returns; run() closes it
+#endif
+    }
     if (server_thread_.joinable()) {
         server_thread_.join();
     }
+
+    // Wakes connection threads blocked in recv() or send(); event streams
+    // notice running_ within a second
+    std::unique_lock<std::mutex> lock(connections_mutex_);
+    for (SOCKET client_fd : connections_) {
+#ifdef _WIN32
+        shutdown(client_fd, SD_BOTH);
+#else
+        shutdown(client_fd, SHUT_RDWR);
+#endif
+    }
+    connections_cv_.wait(lock, [this]() { return connections_.empty(); });
+    lock.unlock();
+    asset_cache_.stop();
 }
 
 void WebServer::run() {
+    // Connection threads start from here and inherit the mask
+    if (!cpus_.empty()) {
+        CpuAffinity::pinCurrentThread(cpus_);
+    }
+
     SOCKET server_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
     if (server_fd == INVALID_SOCKET) {
         std::cerr << "Failed to create socket" << std::endl;
@@ -80,6 +139,7 @@ void WebServer::run() {
         closesocket(server_fd);
         return;
     }
+    listen_fd_ = server_fd;
 
     while (running_) {
         sockaddr_in client_addr;
@@ -90,39 +150,296 @@ void WebServer::run() {
             continue;
         }
 
+        {
+            std::lock_guard<std::mutex> lock(connections_mutex_);
+            if (!running_) {
+                closesocket(client_fd);
+                break;
+            }
+            connections_.insert(client_fd);
+        }
+        // stop() waits for the set to empty, so nothing of this object is
+        // touched once the socket is out of it
         std::thread([this, client_fd]() {
-            handleRequest(client_fd);
+            handleConnection(client_fd);
+            {
+                std::lock_guard<std::mutex> lock(connections_mutex_);
+                connections_.erase(client_fd);
+                connections_cv_.notify_all();
+            }
             closesocket(client_fd);
         }).detach();
     }
 
+    // On Windows stop() closes the socket itself if it got there first
+    SOCKET listen_fd = listen_fd_.exchange(INVALID_SOCKET);
+#ifdef _WIN32
+    if (listen_fd == server_fd) {
+        closesocket(server_fd);
+    }
+#else
+    (void)listen_fd;
     closesocket(server_fd);
+#endif
+}
+
+std::string HttpRequest::header(const std::string& name) const {
+    auto it = headers.find(name);
+    return it != headers.end() ? it->second : "";
+}
+
+std::string HttpRequest::queryParam(const std::string& name) const {
+    std::istringstream params(query);
+    std::string param;
+    while (std::getline(params, param, '&')) {
+        size_t equals = param.find('=');
+        if (param.substr(0, equals) == name) {
+            return equals == std::string::npos ? "" : param.substr(equals + 1);
+        }
+    }
+    return "";
+}
+
+static std::string toLower(std::string value) {
+    std::transform(value.begin(), value.end(), value.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return value;
+}
+
+static std::string trim(const std::string& value) {
+    size_t first = value.find_first_not_of(" \t");
+    if (first == std::string::npos) return "";
+    size_t last = value.find_last_not_of(" \t");
+    return value.substr(first, last - first + 1);
+}
+
+// Whether the last socket error means the client closed or reset the connection
+static bool clientGone() {
+#ifdef _WIN32
+    int error = WSAGetLastError();
+    return error == WSAECONNRESET || error == WSAECONNABORTED;
+#else
+    return errno == EPIPE || errno == ECONNRESET;
+#endif
+}
+
+// A response was cut short, so the connection can't carry another one;
+// the next recv() in handleConnection sees the shutdown and ends it
+static void abandonConnection(SOCKET client_fd) {
+    if (clientGone()) {
+        LOG_DEBUG("[WEB] Client closed the connection mid-response");
+    } else {
+        LOG_WARN("[WEB] Error sending data to client");
+    }
+#ifdef _WIN32
+    shutdown(client_fd, SD_BOTH);
+#else
+    shutdown(client_fd, SHUT_RDWR);
+#endif
 }
 
-void WebServer::handleRequest(SOCKET client_fd) {
-    char buffer[4096] = {0};
-    int bytes_read = recv(client_fd, buffer, sizeof(buffer) - 1, 0);
-    if (bytes_read <= 0) return;
+// True once the client has closed its end. An event stream never reads
+// from the socket, so this is how a closed dashboard tab is noticed
+// between pushes rather than by the next failed write
+static bool peerClosed(SOCKET client_fd) {
+#ifdef MSG_DONTWAIT
+    char byte;
+    int peeked = recv(client_fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    return peeked == 0 ||
+           (peeked < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR);
+#else
+    (void)client_fd;
+    return false;  // the next heartbeat write finds out instead
+#endif
+}
 
-    std::string request(buffer);
-    std::istringstream request_stream(request);
-    std::string method, path, version;
-    request_stream >> method >> path >> version;
+static const char* statusText(int status_code) {
+    switch (status_code) {
+        case 200: return "OK";
+        case 206: return "Partial Content";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 413: return "Payload Too Large";
+        case 416: return "Range Not Satisfiable";
+        case 431: return "Request Header Fields Too Large";
+        case 501: return "Not Implemented";
+        default:  return "Error";
+    }
+}
 
+void WebServer::handleConnection(SOCKET client_fd) {
+    // Idle keep-alive connections are closed once recv() times out, and a
+    // client that stops reading a video stream is dropped the same way
+#ifdef _WIN32
+    DWORD timeout_ms = IDLE_TIMEOUT_SEC * 1000;
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout_ms, sizeof(timeout_ms));
+    setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, (const char*)&timeout_ms, sizeof(timeout_ms));
+#else
+    timeval timeout{IDLE_TIMEOUT_SEC, 0};
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+    setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, (const char*)&timeout, sizeof(timeout));
+#endif
+    // Responses are written in one piece, so don't let Nagle hold back the
+    // next one while the client is still delaying its ACK
+    int nodelay = 1;
+    setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, (const char*)&nodelay, sizeof(nodelay));
+#ifdef SO_NOSIGPIPE
+    // No MSG_NOSIGNAL on macOS/BSD; the socket option does the same
+    int nosigpipe = 1;
+    setsockopt(client_fd, SOL_SOCKET, SO_NOSIGPIPE, (const char*)&nosigpipe, sizeof(nosigpipe));
+#endif
+
+    std::string buffer;
+    char chunk[16 * 1024];
+    int requests_served = 0;
+
+    while (running_) {
+        HttpRequest request;
+        size_t consumed = 0;
+        ParseResult result = parseRequest(buffer, request, consumed);
+
+        if (result == ParseResult::Incomplete) {
+            int bytes_read = recv(client_fd, chunk, sizeof(chunk), 0);
+            if (bytes_read <= 0) {
+                return; // Client closed, error or idle timeout
+            }
+            buffer.append(chunk, bytes_read);
+            continue;
+        }
+
+        if (result != ParseResult::Complete) {
+            int status_code = 400;
+            if (result == ParseResult::HeadersTooLarge) status_code = 431;
+            else if (result == ParseResult::BodyTooLarge) status_code = 413;
+            else if (result == ParseResult::Unsupported) status_code = 501;
+
+            std::string error_page = "<html><body><h1>" + std::to_string(status_code) +
+                                     " " + statusText(status_code) + "</h1></body></html>";
+            sendResponse(client_fd, request, status_code, "text/html", error_page);
+            return;
+        }
+
+        // Pipelined requests stay in the buffer and are answered in order
+        buffer.erase(0, consumed);
+
+        if (++requests_served >= MAX_REQUESTS_PER_CONNECTION) {
+            request.keep_alive = false;
+        }
+
+        if (!handleRequest(client_fd, request)) {
+            return;
+        }
+    }
+}
+
+WebServer::ParseResult WebServer::parseRequest(const std::string& buffer,
+                                               HttpRequest& request,
+                                               size_t& consumed) {
+    size_t header_end = buffer.find("\r\n\r\n");
+    if (header_end == std::string::npos) {
+        return buffer.size() > MAX_HEADER_SIZE ? ParseResult::HeadersTooLarge
+                                               : ParseResult::Incomplete;
+    }
+    if (header_end > MAX_HEADER_SIZE) {
+        return ParseResult::HeadersTooLarge;
+    }
+
+    // Request line
+    size_t line_end = buffer.find("\r\n");
+    std::istringstream request_line(buffer.substr(0, line_end));
+    if (!(request_line >> request.method >> request.path >> request.version) ||
+        request.version.rfind("HTTP/1.", 0) != 0) {
+        return ParseResult::Invalid;
+    }
+
+    size_t question = request.path.find('?');
+    if (question != std::string::npos) {
+        request.query = request.path.substr(question + 1);
+        request.path.resize(question);
+    }
+
+    // Header fields
+    size_t pos = line_end + 2;
+    while (pos < header_end) {
+        size_t eol = buffer.find("\r\n", pos);
+        size_t colon = buffer.find(':', pos);
+        if (colon == std::string::npos || colon > eol) {
+            return ParseResult::Invalid;
+        }
+
+        std::string name = toLower(buffer.substr(pos, colon - pos));
+        std::string value = trim(buffer.substr(colon + 1, eol - colon - 1));
+
+        auto it = request.headers.find(name);
+        if (it != request.headers.end()) {
+            it->second += ", " + value;
+        } else {
+            request.headers.emplace(std::move(name), std::move(value));
+        }
+        pos = eol + 2;
+    }
+
+    std::string connection = toLower(request.header("connection"));
+    if (request.version == "HTTP/1.0") {
+        request.keep_alive = connection.find("keep-alive") != std::string::npos;
+    } else {
+        request.keep_alive = connection.find("close") == std::string::npos;
+    }
+
+    if (!request.header("transfer-encoding").empty()) {
+        request.keep_alive = false;
+        return ParseResult::Unsupported;
+    }
+
+    // Body (only Content-Length framing is supported)
+    size_t content_length = 0;
+    std::string length_value = request.header("content-length");
+    if (!length_value.empty()) {
+        if (length_value.find_first_not_of("0123456789") != std::string::npos ||
+            length_value.size() > 12) {
+            request.keep_alive = false;
+            return ParseResult::Invalid;
+        }
+        content_length = std::stoull(length_value);
+    }
+    if (content_length > MAX_BODY_SIZE) {
+        request.keep_alive = false;
+        return ParseResult::BodyTooLarge;
+    }
+
+    size_t body_start = header_end + 4;
+    if (buffer.size() - body_start < content_length) {
+        return ParseResult::Incomplete;
+    }
+
+    request.body = buffer.substr(body_start, content_length);
+    consumed = body_start + content_length;
+    return ParseResult::Complete;
+}
+
+bool WebServer::handleRequest(SOCKET client_fd, const HttpRequest& request) {
     // Filter out favicon noise
-    if (path != "/favicon.ico") {
-        std::cout << "[WEB] " << method << " " << path << std::endl;
+    if (request.path != "/favicon.ico") {
+        LOG_DEBUG("[WEB] " << request.method << " " << request.path);
+    }
+
+    if (request.path == "/api/events") {
+        // The event stream owns the connection until the client goes away
+        handleEventStream(client_fd, request);
+        return false;
     }
 
-    if (path.find("/api/") == 0) {
-        handleApiRequest(client_fd, method, path);
+    if (request.path.find("/api/") == 0) {
+        handleApiRequest(client_fd, request);
     } else {
-        handleFileRequest(client_fd, path);
+        handleFileRequest(client_fd, request);
     }
+    return request.keep_alive;
 }
 
-void WebServer::handleApiRequest(SOCKET client_fd, const std::string& method, 
-                                const std::string& path) {
+void WebServer::handleApiRequest(SOCKET client_fd, const HttpRequest& request) {
+    const std::string& path = request.path;
     std::string response_body;
     std::string content_type = "application/json";
 
@@ -131,151 +448,640 @@ void WebServer::handleApiRequest(SOCKET client_fd, const std::string& method,
     } else if (path == "/api/queue") {
         response_body = getQueueStatusJson();
     } else if (path == "/api/videos") {
-        response_body = getVideosJson();
+        handleVideosRequest(client_fd, request);
+        return;
+    } else if (path == "/api/trace") {
+        // Chrome trace event JSON of the sampled uploads; open it in
+        // ui.perfetto.dev or chrome://tracing
+        sendResponse(client_fd, request, 200, content_type,
+                     consumer_server_->tracer().toJson(),
+                     "Content-Disposition: attachment; filename=\"upload_trace.json\"\r\n"
+                     "Cache-Control: no-store\r\n");
+        return;
     } else {
         response_body = R"({"error": "Not found"})";
-        sendResponse(client_fd, 404, content_type, response_body);
+        sendResponse(client_fd, request, 404, content_type, response_body);
         return;
     }
 
-    sendResponse(client_fd, 200, content_type, response_body);
+    sendResponse(client_fd, request, 200, content_type, response_body);
 }
 
-void WebServer::handleFileRequest(SOCKET client_fd, const std::string& path) {
+void WebServer::handleFileRequest(SOCKET client_fd, const HttpRequest& request) {
+    const std::string& path = request.path;
     std::string file_path;
 
+    // Web assets (index.html, css, js) are answered from memory
+    if (path.find("/app/uploaded_videos") != 0 && path.find("/uploaded_videos") != 0) {
+        auto asset = asset_cache_.find(path == "/" ? "/index.html" : path);
+        if (!asset) {
+            std::string not_found = "<html><body><h1>404 Not Found</h1></body></html>";
+            sendResponse(client_fd, request, 404, "text/html", not_found);
+            return;
+        }
+        serveAsset(client_fd, request, *asset);
+        return;
+    }
+
     // FIX 1: Check if the path is an absolute path to the uploaded videos (Docker environment)
     if (path.find("/app/uploaded_videos") == 0) {
         file_path = path;
     } 
     // Fallback for local testing (if videos are in ./uploaded_videos)
-    else if (path.find("/uploaded_videos") == 0) {
+    else {
         file_path = "." + path; 
     }
-    // Otherwise, treat as a standard web asset (index.html, css, js)
-    else {
-        file_path = web_root_;
-        if (path == "/") {
-            file_path += "/index.html";
-        } else {
-            file_path += path;
+
+    // Uploaded videos can be gigabytes: stream them without buffering
+    serveFile(client_fd, request, file_path, StaticAssetCache::contentTypeFor(file_path));
+}
+
+// True if Accept-Encoding gives the coding a non-zero q. The coding's
+// own entry wins over "*" wherever each appears, so "*, br;q=0" refuses br.
+static bool acceptsEncoding(const std::string& accept_encoding, const std::string& coding) {
+    double exact_quality = -1.0;
+    double wildcard_quality = -1.0;
+    std::istringstream entries(accept_encoding);
+    std::string entry;
+    while (std::getline(entries, entry, ',')) {
+        std::istringstream parts(entry);
+        std::string part;
+        std::getline(parts, part, ';');
+        std::string name = toLower(trim(part));
+        if (name != coding && name != "*") {
+            continue;
         }
+
+        double quality = 1.0;
+        while (std::getline(parts, part, ';')) {
+            std::string param = toLower(trim(part));
+            if (param.rfind("q=", 0) == 0) {
+                quality = std::atof(param.c_str() + 2);
+            }
+        }
+        (name == coding ? exact_quality : wildcard_quality) = quality;
     }
+    return (exact_quality >= 0.0 ? exact_quality : wildcard_quality) > 0.0;
+}
 
-    std::ifstream file(file_path, std::ios::binary);
-    if (!file) {
+// True if an If-None-Match / If-Range value lists the given entity tag
+static bool etagMatches(const std::string& header_value, const std::string& etag) {
+    std::istringstream tags(header_value);
+    std::string tag;
+    while (std::getline(tags, tag, ',')) {
+        tag = trim(tag);
+        if (tag == "*") return true;
+        if (tag.rfind("W/", 0) == 0) tag = tag.substr(2);
+        if (tag == etag) return true;
+    }
+    return false;
+}
+
+enum class RangeResult { None, Satisfiable, Unsatisfiable };
+
+// Parses a single "bytes=" range; multi-range requests are answered with the full body
+static RangeResult parseRange(const std::string& header_value, size_t file_size,
+                              size_t& start, size_t& end) {
+    if (header_value.rfind("bytes=", 0) != 0 ||
+        header_value.find(',') != std::string::npos) {
+        return RangeResult::None;
+    }
+
+    std::string spec = trim(header_value.substr(6));
+    size_t dash = spec.find('-');
+    if (dash == std::string::npos ||
+        spec.find_first_not_of("0123456789-") != std::string::npos ||
+        spec.find('-', dash + 1) != std::string::npos) {
+        return RangeResult::None;
+    }
+
+    std::string first = spec.substr(0, dash);
+    std::string last = spec.substr(dash + 1);
+    if ((first.empty() && last.empty()) || first.size() > 19 || last.size() > 19) {
+        return RangeResult::None;
+    }
+
+    if (first.empty()) {
+        // Suffix range: the last N bytes
+        size_t suffix = std::stoull(last);
+        if (suffix == 0 || file_size == 0) return RangeResult::Unsatisfiable;
+        start = suffix >= file_size ? 0 : file_size - suffix;
+        end = file_size - 1;
+        return RangeResult::Satisfiable;
+    }
+
+    start = std::stoull(first);
+    if (start >= file_size) return RangeResult::Unsatisfiable;
+    end = last.empty() ? file_size - 1 : std::min<size_t>(std::stoull(last), file_size - 1);
+    if (end < start) return RangeResult::None;
+    return RangeResult::Satisfiable;
+}
+
+void WebServer::serveAsset(SOCKET client_fd, const HttpRequest& request,
+                           const StaticAsset& asset) {
+    // Pick the smallest representation the client can decode
+    const std::string* body = &asset.identity;
+    std::string encoding;
+    std::string accept_encoding = request.header("accept-encoding");
+
+    if (!asset.brotli.empty() && acceptsEncoding(accept_encoding, "br")) {
+        body = &asset.brotli;
+        encoding = "br";
+    } else if (!asset.gzip.empty() && acceptsEncoding(accept_encoding, "gzip")) {
+        body = &asset.gzip;
+        encoding = "gzip";
+    }
+
+    // Each encoding is a different representation, so it gets its own strong ETag
+    std::string etag = asset.etag;
+    if (!encoding.empty()) {
+        etag.insert(etag.size() - 1, "-" + encoding);
+    }
+
+    std::string headers = "ETag: " + etag + "\r\n" +
+                          "Cache-Control: " + asset.cache_control + "\r\n" +
+                          "Vary: Accept-Encoding\r\n";
+
+    std::string if_none_match = request.header("if-none-match");
+    if (!if_none_match.empty() && etagMatches(if_none_match, etag)) {
+        sendResponse(client_fd, request, 304, asset.content_type, "", headers);
+        return;
+    }
+
+    if (!encoding.empty()) {
+        headers += "Content-Encoding: " + encoding + "\r\n";
+    }
+    sendResponse(client_fd, request, 200, asset.content_type, *body, headers);
+}
+
+void WebServer::serveFile(SOCKET client_fd, const HttpRequest& request,
+                          const std::string& file_path,
+                          const std::string& content_type) {
+    std::error_code ec;
+    if (!fs::is_regular_file(file_path, ec)) {
         std::string not_found = "<html><body><h1>404 Not Found</h1></body></html>";
-        sendResponse(client_fd, 404, "text/html", not_found);
+        sendResponse(client_fd, request, 404, "text/html", not_found);
         return;
     }
 
-    // Read file content
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    std::string content = buffer.str();
-
-    // Determine Content-Type
-    std::string content_type = "text/html";
-    if (file_path.ends_with(".css")) content_type = "text/css";
-    else if (file_path.ends_with(".js")) content_type = "application/javascript";
-    else if (file_path.ends_with(".mp4")) content_type = "video/mp4";
-    else if (file_path.ends_with(".jpg")) content_type = "image/jpeg";
-    else if (file_path.ends_with(".png")) content_type = "image/png";
-
-    sendResponse(client_fd, 200, content_type, content);
-}
-
-void WebServer::sendResponse(SOCKET client_fd, int status_code, 
-                            const std::string& content_type,
-                            const std::string& body) {
-    std::string status_text = (status_code == 200) ? "OK" : "Not Found";
-    
-    std::ostringstream response;
-    response << "HTTP/1.1 " << status_code << " " << status_text << "\r\n";
-    response << "Content-Type: " << content_type << "\r\n";
-    response << "Content-Length: " << body.length() << "\r\n";
-    response << "Access-Control-Allow-Origin: *\r\n";
-    response << "Connection: close\r\n";
-    response << "\r\n";
-    response << body;
-
-    std::string response_str = response.str();
-    
-    // FIX 2: Send data in a loop to ensure large video files are fully transmitted
-    const char* ptr = response_str.c_str();
-    size_t total_len = response_str.length();
-    size_t total_sent = 0;
+    size_t file_size = fs::file_size(file_path, ec);
+    auto modified = fs::last_write_time(file_path, ec).time_since_epoch().count();
 
-    while (total_sent < total_len) {
-        int sent = send(client_fd, ptr + total_sent, 
-                       static_cast<int>(total_len - total_sent), 0);
-        
+    // Uploaded files are written once, so size + mtime identifies the content
+    std::ostringstream etag_stream;
+    etag_stream << "\"" << std::hex << file_size << "-" << modified << "\"";
+    std::string etag = etag_stream.str();
+
+    std::string validators = "ETag: " + etag + "\r\nAccept-Ranges: bytes\r\n";
+
+    std::string if_none_match = request.header("if-none-match");
+    if (!if_none_match.empty() && etagMatches(if_none_match, etag)) {
+        sendResponse(client_fd, request, 304, content_type, "", validators);
+        return;
+    }
+
+    size_t start = 0;
+    size_t end = file_size == 0 ? 0 : file_size - 1;
+    RangeResult range = RangeResult::None;
+
+    std::string range_header = request.header("range");
+    std::string if_range = request.header("if-range");
+    if (!range_header.empty() && (if_range.empty() || if_range == etag)) {
+        range = parseRange(range_header, file_size, start, end);
+    }
+
+    if (range == RangeResult::Unsatisfiable) {
+        sendResponse(client_fd, request, 416, content_type, "",
+                     validators + "Content-Range: bytes */" + std::to_string(file_size) + "\r\n");
+        return;
+    }
+
+    size_t length = file_size == 0 ? 0 : end - start + 1;
+    int status_code = 200;
+    if (range == RangeResult::Satisfiable) {
+        status_code = 206;
+        validators += "Content-Range: bytes " + std::to_string(start) + "-" +
+                      std::to_string(end) + "/" + std::to_string(file_size) + "\r\n";
+    }
+
+    std::string headers = buildHeaders(request, status_code, content_type, length, validators);
+    if (!sendAll(client_fd, headers.data(), headers.length())) {
+        return;
+    }
+
+    if (request.method != "HEAD" && length > 0 &&
+        !sendFileRange(client_fd, file_path, start, length)) {
+        LOG_DEBUG("[WEB] Stopped streaming " << file_path);
+    }
+}
+
+bool WebServer::sendFileRange(SOCKET client_fd, const std::string& file_path,
+                              size_t offset, size_t length) {
+#ifdef __linux__
+    // Zero-copy: the kernel moves pages from the page cache to the socket
+    int file_fd = open(file_path.c_str(), O_RDONLY);
+    if (file_fd < 0) {
+        return false;
+    }
+
+    off_t position = static_cast<off_t>(offset);
+    size_t remaining = length;
+    bool ok = true;
+
+    while (remaining > 0) {
+        ssize_t sent = sendfile(client_fd, file_fd, &position,
+                                std::min(remaining, SENDFILE_CHUNK_SIZE));
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
         if (sent <= 0) {
-            std::cerr << "[WEB] Error sending data to client" << std::endl;
+            ok = false;
+            abandonConnection(client_fd);
             break;
         }
+        remaining -= sent;
+    }
+
+    close(file_fd);
+    return ok;
+#else
+    // Portable fallback: a fixed-size buffer, so memory use doesn't grow with the file
+    std::ifstream file(file_path, std::ios::binary);
+    if (!file || !file.seekg(offset)) {
+        return false;
+    }
+
+    std::vector<char> buffer(SENDFILE_CHUNK_SIZE);
+    size_t remaining = length;
+    while (remaining > 0) {
+        size_t to_read = std::min(remaining, buffer.size());
+        if (!file.read(buffer.data(), to_read)) {
+            return false;
+        }
+        if (!sendAll(client_fd, buffer.data(), to_read)) {
+            return false;
+        }
+        remaining -= to_read;
+    }
+    return true;
+#endif
+}
+
+std::string WebServer::buildHeaders(const HttpRequest& request, int status_code,
+                                    const std::string& content_type,
+                                    size_t content_length,
+                                    const std::string& extra_headers) {
+    std::ostringstream headers;
+    headers << "HTTP/1.1 " << status_code << " " << statusText(status_code) << "\r\n";
+    if (status_code != 304) {
+        headers << "Content-Type: " << content_type << "\r\n";
+        headers << "Content-Length: " << content_length << "\r\n";
+    }
+    headers << extra_headers;
+    headers << "Access-Control-Allow-Origin: *\r\n";
+    if (request.keep_alive) {
+        headers << "Connection: keep-alive\r\n";
+        headers << "Keep-Alive: timeout=" << IDLE_TIMEOUT_SEC
+                << ", max=" << MAX_REQUESTS_PER_CONNECTION << "\r\n";
+    } else {
+        headers << "Connection: close\r\n";
+    }
+    headers << "\r\n";
+    return headers.str();
+}
+
+void WebServer::sendResponse(SOCKET client_fd, const HttpRequest& request,
+                            int status_code, const std::string& content_type,
+                            const std::string& body,
+                            const std::string& extra_headers) {
+    std::string response_str = buildHeaders(request, status_code, content_type,
+                                            body.length(), extra_headers);
+    if (request.method != "HEAD" && status_code != 304) {
+        response_str += body;
+    }
+
+    // FIX 2: Send data in a loop to ensure large video files are fully transmitted
+    sendAll(client_fd, response_str.data(), response_str.length());
+}
+
+bool WebServer::sendAll(SOCKET client_fd, const char* data, size_t length) {
+    size_t total_sent = 0;
+    while (total_sent < length) {
+        int sent = send(client_fd, data + total_sent,
+                       static_cast<int>(length - total_sent), SEND_FLAGS);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            abandonConnection(client_fd);
+            return false;
+        }
         total_sent += sent;
     }
+    return true;
 }
 
 std::string WebServer::getStatisticsJson() {
+    ServerStatistics stats = consumer_server_->getStatistics();
+
     std::ostringstream json;
-    // Note: consumer_server_ should provide these, but for now we are mocking or 
-    // relying on the consumer server to be passed in correctly.
-    // Ideally you would add getters to ConsumerServer to retrieve these values.
     json << "{"
-         << "\"total_received\": 0,"
-         << "\"total_processed\": 0,"
-         << "\"total_dropped\": 0,"
-         << "\"total_duplicates\": 0"
+         << "\"total_received\": " << stats.total_received << ","
+         << "\"total_processed\": " << stats.total_processed << ","
+         << "\"total_dropped\": " << stats.total_dropped << ","
+         << "\"total_duplicates\": " << stats.total_duplicates << ","
+         << "\"memory_in_use\": " << stats.memory_in_use << ","
+         << "\"memory_limit\": " << stats.memory_limit << ","
+         << "\"memory_peak\": " << stats.memory_peak << ","
+         << "\"memory_waiting\": " << stats.memory_waiting << ","
+         << "\"memory_waits\": " << stats.memory_waits << ","
+         << "\"memory_blocked_ms\": " << stats.memory_blocked_ms
          << "}";
-    
-    // Attempt to get real stats if available (requires ConsumerServer modification)
-    // For this specific exercise file, we will check if the user implemented getters
-    // or if we rely on the Metadata call below.
     return json.str();
 }
 
 std::string WebServer::getQueueStatusJson() {
+    return queueStatusToJson(consumer_server_->getStatistics());
+}
+
+std::string WebServer::queueStatusToJson(const ServerStatistics& stats) {
     std::ostringstream json;
     json << "{"
-         << "\"current_size\": 0,"
-         << "\"max_size\": 10,"
-         << "\"is_full\": false,"
-         << "\"available_slots\": 10"
+         << "\"current_size\": " << stats.queue_size << ","
+         << "\"max_size\": " << stats.max_queue_size << ","
+         << "\"is_full\": " << (stats.queue_size >= stats.max_queue_size ? "true" : "false") << ","
+         << "\"available_slots\": " << std::max(0, stats.max_queue_size - stats.queue_size)
          << "}";
     return json.str();
 }
 
-std::string WebServer::getVideosJson() {
+// Appends a string as JSON string content; runs of characters that need
+// no escaping are copied in bulk
+static void appendJsonEscaped(std::string& out, std::string_view value) {
+    static const char hex_digits[] = "0123456789abcdef";
+    size_t run_start = 0;
+
+    for (size_t i = 0; i < value.size(); i++) {
+        unsigned char c = static_cast<unsigned char>(value[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+
+        out.append(value.data() + run_start, i - run_start);
+        switch (c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            default:
+                out += "\\u00";
+                out += hex_digits[c >> 4];
+                out += hex_digits[c & 0xf];
+        }
+        run_start = i + 1;
+    }
+    out.append(value.data() + run_start, value.size() - run_start);
+}
+
+template <typename T>
+static void appendNumber(std::string& out, T value) {
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, result.ptr);
+}
+
+static void appendVideoJson(std::string& out, const VideoMetadata& video) {
+    out += "{\"video_id\":\"";
+    appendJsonEscaped(out, video.video_id);
+    out += "\",\"filename\":\"";
+    appendJsonEscaped(out, video.filename);
+    out += "\",\"file_path\":\"";
+    appendJsonEscaped(out, video.file_path); // This path is /app/uploaded_videos/...
+    out += "\",\"producer_id\":";
+    appendNumber(out, video.producer_id);
+    out += ",\"file_size\":";
+    appendNumber(out, video.file_size);
+    out += ",\"upload_timestamp\":";
+    appendNumber(out, static_cast<int64_t>(
+        std::chrono::system_clock::to_time_t(video.upload_time)));
+    out += ",\"is_duplicate\":";
+    out += video.is_duplicate ? "true}" : "false}";
+}
+
+static std::string videosToJson(const std::vector<VideoMetadata>& videos) {
+    std::string json = "[";
+    for (const auto& video : videos) {
+        if (json.size() > 1) {
+            json += ',';
+        }
+        appendVideoJson(json, video);
+    }
+    json += ']';
+    return json;
+}
+
+void WebServer::handleVideosRequest(SOCKET client_fd, const HttpRequest& request) {
+    std::string headers = "Access-Control-Expose-Headers: ETag, X-Videos-Version\r\n";
+
+    // Delta query: only the entries added after the given version
+    std::string since = request.queryParam("since");
+    if (!since.empty()) {
+        if (since.size() > 19 || since.find_first_not_of("0123456789") != std::string::npos) {
+            sendResponse(client_fd, request, 400, "application/json",
+                         R"({"error": "Invalid since parameter"})");
+            return;
+        }
+
+        uint64_t version = 0;
+        auto videos = consumer_server_->getVideoMetadataSince(std::stoull(since), &version);
+        headers += "Cache-Control: no-store\r\nX-Videos-Version: " + std::to_string(version) + "\r\n";
+        sendResponse(client_fd, request, 200, "application/json", videosToJson(videos), headers);
+        return;
+    }
+
+    uint64_t version = 0;
+    auto segments = getVideosJson(version);
+
+    std::string etag = "\"videos-" + std::to_string(version) + "\"";
+    headers += "ETag: " + etag + "\r\n" +
+               "Cache-Control: no-cache\r\n" +
+               "X-Videos-Version: " + std::to_string(version) + "\r\n";
+
+    std::string if_none_match = request.header("if-none-match");
+    if (!if_none_match.empty() && etagMatches(if_none_match, etag)) {
+        sendResponse(client_fd, request, 304, "application/json", "", headers);
+        return;
+    }
+
+    // The body is "[" + segments + "]"; segments are sent as they are, without
+    // first being joined into one string
+    size_t content_length = 2;
+    for (const auto& segment : segments) {
+        content_length += segment->size();
+    }
+
+    std::string head = buildHeaders(request, 200, "application/json", content_length, headers);
+    if (request.method == "HEAD") {
+        sendAll(client_fd, head.data(), head.size());
+        return;
+    }
+
+    head += '[';
+    bool ok = sendAll(client_fd, head.data(), head.size());
+    for (size_t i = 0; ok && i < segments.size(); i++) {
+        ok = sendAll(client_fd, segments[i]->data(), segments[i]->size());
+    }
+    if (ok) {
+        sendAll(client_fd, "]", 1);
+    }
+}
+
+std::vector<std::shared_ptr<const std::string>> WebServer::getVideosJson(uint64_t& version) {
     // This part handles the metadata retrieval which is the core of the dashboard
-    auto metadata = consumer_server_->getVideoMetadata();
-    
-    std::ostringstream json;
-    json << "[";
-    
-    for (size_t i = 0; i < metadata.size(); i++) {
-        const auto& video = metadata[i];
-        auto timestamp = std::chrono::system_clock::to_time_t(video.upload_time);
-        
-        // Escape filenames just in case
-        std::string safe_filename = video.filename; // Should add escaping logic for real prod
-        
-        json << "{"
-             << "\"video_id\":\"" << video.video_id << "\","
-             << "\"filename\":\"" << safe_filename << "\","
-             << "\"file_path\":\"" << video.file_path << "\"," // This path is /app/uploaded_videos/...
-             << "\"producer_id\":" << video.producer_id << ","
-             << "\"file_size\":" << video.file_size << ","
-             << "\"upload_timestamp\":" << timestamp << ","
-             << "\"is_duplicate\":" << (video.is_duplicate ? "true" : "false")
-             << "}";
-        
-        if (i < metadata.size() - 1) {
-            json << ",";
+    std::lock_guard<std::mutex> lock(videos_json_mutex_);
+
+    if (consumer_server_->getMetadataVersion() != videos_json_version_) {
+        // Only entries added since the cached version are serialized. Full
+        // segments are never touched again; only the last one is copied.
+        uint64_t current_version = 0;
+        auto fresh = consumer_server_->getVideoMetadataSince(videos_json_version_, &current_version);
+
+        auto segment = std::make_shared<std::string>();
+        if (!videos_json_segments_.empty() &&
+            videos_json_segments_.back()->size() < VIDEOS_JSON_SEGMENT_SIZE) {
+            *segment = *videos_json_segments_.back();
+            videos_json_segments_.pop_back();
         }
+        segment->reserve(VIDEOS_JSON_SEGMENT_SIZE + 1024);
+
+        bool first_entry = videos_json_segments_.empty() && segment->empty();
+        for (const auto& video : fresh) {
+            if (!first_entry) {
+                *segment += ',';
+            }
+            first_entry = false;
+            appendVideoJson(*segment, video);
+
+            if (segment->size() >= VIDEOS_JSON_SEGMENT_SIZE) {
+                videos_json_segments_.push_back(std::move(segment));
+                segment = std::make_shared<std::string>();
+                segment->reserve(VIDEOS_JSON_SEGMENT_SIZE + 1024);
+            }
+        }
+        if (!segment->empty()) {
+            videos_json_segments_.push_back(std::move(segment));
+        }
+
+        videos_json_version_ = current_version;
     }
-    
-    json << "]";
-    return json.str();
-}
\ No newline at end of file
+
+    version = videos_json_version_;
+    return videos_json_segments_;
+}
+
+void WebServer::handleEventStream(SOCKET client_fd, const HttpRequest& request) {
+    // Video events resume after Last-Event-ID on reconnect, or after ?since=
+    // on the first connect; otherwise only videos added from now on are sent
+    std::string resume = request.header("last-event-id");
+    if (resume.empty()) {
+        resume = request.queryParam("since");
+    }
+    uint64_t video_version = 0;
+    if (!resume.empty() && resume.size() <= 19 &&
+        resume.find_first_not_of("0123456789") == std::string::npos) {
+        video_version = std::stoull(resume);
+    } else {
+        video_version = consumer_server_->getMetadataVersion();
+    }
+
+    std::string head = "HTTP/1.1 200 OK\r\n"
+                       "Content-Type: text/event-stream\r\n"
+                       "Cache-Control: no-cache\r\n"
+                       "Access-Control-Allow-Origin: *\r\n"
+                       "Connection: keep-alive\r\n"
+                       "\r\n"
+                       "retry: 3000\n\n";
+    if (!sendAll(client_fd, head.data(), head.size())) {
+        return;
+    }
+
+    const auto min_interval = std::chrono::milliseconds(1000 / max_events_per_sec_);
+    const auto heartbeat_interval = std::chrono::seconds(EVENT_HEARTBEAT_SEC);
+
+    // Sequence number first, snapshot second: a change racing with the
+    // snapshot still wakes the next wait
+    uint64_t seen_seq = consumer_server_->waitForChange(0, std::chrono::milliseconds(0));
+    std::optional<ServerStatistics> last_stats;
+    auto last_push = std::chrono::steady_clock::now();
+    auto last_write = last_push;
+
+    while (running_) {
+        if (peerClosed(client_fd)) {
+            LOG_DEBUG("[WEB] Dashboard disconnected from the event stream");
+            return;
+        }
+
+        std::string events;
+        ServerStatistics stats = consumer_server_->getStatistics();
+
+        // Statistics: only the counters that moved since the last push
+        // (all of them on the first one)
+        ServerStatistics previous = last_stats.value_or(ServerStatistics{});
+        std::string delta;
+        auto addField = [&](const char* name, int value, int previous_value) {
+            if (last_stats && value == previous_value) return;
+            delta += delta.empty() ? "{\"" : ",\"";
+            delta += name;
+            delta += "\":";
+            appendNumber(delta, value);
+        };
+        addField("total_received", stats.total_received, previous.total_received);
+        addField("total_processed", stats.total_processed, previous.total_processed);
+        addField("total_dropped", stats.total_dropped, previous.total_dropped);
+        addField("total_duplicates", stats.total_duplicates, previous.total_duplicates);
+        if (!delta.empty()) {
+            events += "event: stats\ndata: " + delta + "}\n\n";
+        }
+
+        if (!last_stats || previous.queue_size != stats.queue_size ||
+            previous.max_queue_size != stats.max_queue_size) {
+            events += "event: queue\ndata: " + queueStatusToJson(stats) + "\n\n";
+        }
+        last_stats = stats;
+
+        // Newly committed videos; the id lets a reconnect pick up from here
+        uint64_t current_version = 0;
+        auto videos = consumer_server_->getVideoMetadataSince(video_version, &current_version);
+        if (!videos.empty()) {
+            events += "id: " + std::to_string(current_version) + "\n";
+            events += "event: videos\ndata: " + videosToJson(videos) + "\n\n";
+        }
+        video_version = current_version;
+
+        auto now = std::chrono::steady_clock::now();
+        if (events.empty() && now - last_write >= heartbeat_interval) {
+            events = ": ping\n\n"; // keeps proxies from timing out and detects dead clients
+        }
+        if (!events.empty()) {
+            if (!sendAll(client_fd, events.data(), events.size())) {
+                return;
+            }
+            last_write = now;
+        }
+        last_push = now;
+
+        uint64_t seq = consumer_server_->waitForChange(seen_seq, std::chrono::seconds(1));
+        if (seq == seen_seq) {
+            continue;
+        }
+        seen_seq = seq;
+
+        // Coalesce bursts: everything that changes before the next slot is
+        // merged into a single push
+        std::this_thread::sleep_until(last_push + min_interval);
+        seen_seq = consumer_server_->waitForChange(seen_seq, std::chrono::milliseconds(0));
+    }
+}